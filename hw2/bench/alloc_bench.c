@@ -0,0 +1,122 @@
+// ============================================================================
+// alloc_bench.c  — Job allocation microbenchmark (malloc vs arena)
+// ============================================================================
+//
+// One "dispatcher" thread allocates jobs like enqueue_job does (Job node +
+// line copy + op array) and hands them to worker threads, which free them,
+// like worker_thread_main does. Every BARRIER_EVERY jobs the dispatcher
+// waits for all of them and calls arena_reset(), like dispatcher_wait.
+//
+// Usage: alloc_bench [jobs] [workers]
+
+#include <sched.h>
+#include <stdatomic.h>
+#include "../header/func.h"
+#include "../header/arena.h"
+
+#define BARRIER_EVERY  10000
+
+// Normally in func.c; the benchmark links only arena.c
+void report_syscall_error(const char *name)
+{
+    fprintf(stderr, "alloc_bench: %s failed, errno = %d\n", name, errno);
+}
+
+static const char *s_lines[] = {
+    "worker increment 0",
+    "worker increment 1; repeat 4; increment 1",
+    "worker repeat 24; increment 2",
+    "worker increment 3; decrement 3; increment 3",
+    "worker msleep 200; increment 4",
+};
+
+static Job **s_slots;
+static long  s_jobs;
+static _Atomic long s_published;   // slots [0, s_published) are filled
+static _Atomic long s_claimed;     // next slot a worker takes
+static _Atomic long s_freed;
+
+// Also normally in func.c
+long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        long i = atomic_fetch_add(&s_claimed, 1);
+        if (i >= s_jobs)
+            return NULL;
+        while (atomic_load(&s_published) <= i)
+            sched_yield();   // wait until the dispatcher filled slot i
+        job_free(s_slots[i]);
+        atomic_fetch_add(&s_freed, 1);
+    }
+}
+
+static void run(int mode, long jobs, int workers)
+{
+    Op ops[3] = { { OP_ADD, 1, 1 }, { OP_MSLEEP, 5, 0 }, { OP_ADD, 2, -1 } };
+
+    g_alloc_mode = mode;
+    s_jobs = jobs;
+    s_slots = malloc(sizeof(Job *) * (size_t)jobs);
+    atomic_store(&s_published, 0);
+    atomic_store(&s_claimed, 0);
+    atomic_store(&s_freed, 0);
+
+    pthread_t th[64];
+    for (int i = 0; i < workers; i++)
+        pthread_create(&th[i], NULL, worker, NULL);
+
+    long long alloc_ns = 0;
+    long long t0 = now_ns();
+
+    for (long i = 0; i < jobs; i++) {
+        if (i > 0 && i % BARRIER_EVERY == 0) {
+            while (atomic_load(&s_freed) < i)
+                sched_yield();
+            arena_reset();
+        }
+
+        const char *line = s_lines[i % 5];
+        long long a = now_ns();
+        Job *job = job_alloc(line, strlen(line), 1, ops, 1 + (int)(i % 3));
+        alloc_ns += now_ns() - a;
+
+        s_slots[i] = job;
+        atomic_store(&s_published, i + 1);
+    }
+
+    for (int i = 0; i < workers; i++)
+        pthread_join(th[i], NULL);
+
+    long long total_ns = now_ns() - t0;
+    arena_reset();
+    arena_destroy();
+    free(s_slots);
+
+    printf("%-6s %9ld %7d %12.1f %12.1f\n",
+           mode == ALLOC_ARENA ? "arena" : "malloc", jobs, workers,
+           (double)alloc_ns / (double)jobs, (double)total_ns / (double)jobs);
+}
+
+int main(int argc, char *argv[])
+{
+    long jobs   = (argc > 1) ? atol(argv[1]) : 2000000;
+    int workers = (argc > 2) ? atoi(argv[2]) : 4;
+    if (jobs <= 0 || workers <= 0 || workers > 64) {
+        fprintf(stderr, "Usage: alloc_bench [jobs] [workers (1-64)]\n");
+        return 1;
+    }
+
+    printf("%-6s %9s %7s %12s %12s\n",
+           "mode", "jobs", "workers", "alloc ns/job", "total ns/job");
+    run(ALLOC_MALLOC, jobs, workers);
+    run(ALLOC_ARENA,  jobs, workers);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// ============================================================================
+// counter_bench.c  — Counter update microbenchmark
+// ============================================================================
+//
+// Each thread does OPS_PER_THREAD increments spread over NUM_COUNTERS
+// neighbouring counters, with three layouts:
+//
+//   mutex         dense pthread_mutex_t[] + long long[] (the old layout)
+//   padded-mutex  mutex + value alone on a cache line
+//   atomic        padded _Atomic long long, fetch-add (counters=atomic)
+//
+// Usage: counter_bench [max_threads] [ops_per_thread]
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CACHE_LINE    64
+#define NUM_COUNTERS  8
+
+typedef struct PaddedLocked {
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;
+    long long value;
+} PaddedLocked;
+
+typedef struct PaddedAtomic {
+    _Alignas(CACHE_LINE) _Atomic long long value;
+} PaddedAtomic;
+
+static pthread_mutex_t s_dense_mutex[NUM_COUNTERS];
+static long long       s_dense_value[NUM_COUNTERS];
+static PaddedLocked    s_padded[NUM_COUNTERS];
+static PaddedAtomic    s_atomic[NUM_COUNTERS];
+
+static long s_ops;
+static int  s_variant;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *worker(void *arg)
+{
+    unsigned int seed = (unsigned int)(long)arg * 2654435761u + 1;
+
+    for (long i = 0; i < s_ops; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int c = (int)((seed >> 16) % NUM_COUNTERS);
+
+        switch (s_variant) {
+        case 0:
+            pthread_mutex_lock(&s_dense_mutex[c]);
+            s_dense_value[c]++;
+            pthread_mutex_unlock(&s_dense_mutex[c]);
+            break;
+        case 1:
+            pthread_mutex_lock(&s_padded[c].mutex);
+            s_padded[c].value++;
+            pthread_mutex_unlock(&s_padded[c].mutex);
+            break;
+        default:
+            atomic_fetch_add_explicit(&s_atomic[c].value, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+static double run(int variant, int threads)
+{
+    pthread_t th[256];
+    s_variant = variant;
+
+    long long t0 = now_ns();
+    for (int i = 0; i < threads; i++)
+        pthread_create(&th[i], NULL, worker, (void *)(long)i);
+    for (int i = 0; i < threads; i++)
+        pthread_join(th[i], NULL);
+    long long ns = now_ns() - t0;
+
+    return (double)s_ops * threads / ((double)ns / 1e9) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = (argc > 1) ? atoi(argv[1]) : 16;
+    s_ops           = (argc > 2) ? atol(argv[2]) : 1000000;
+    if (max_threads <= 0 || max_threads > 256 || s_ops <= 0) {
+        fprintf(stderr, "Usage: counter_bench [max_threads (1-256)] [ops_per_thread]\n");
+        return 1;
+    }
+
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        pthread_mutex_init(&s_dense_mutex[i], NULL);
+        pthread_mutex_init(&s_padded[i].mutex, NULL);
+        atomic_init(&s_atomic[i].value, 0);
+    }
+
+    printf("%7s %14s %14s %14s   (Mops/s)\n", "threads", "mutex", "padded-mutex", "atomic");
+    for (int t = 1; t <= max_threads; t *= 2) {
+        printf("%7d %14.1f %14.1f %14.1f\n",
+               t, run(0, t), run(1, t), run(2, t));
+    }
+    return 0;
+}
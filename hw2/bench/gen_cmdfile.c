@@ -0,0 +1,150 @@
+// ============================================================================
+// gen_cmdfile.c  — Synthetic cmdfile generator for hw2
+// ============================================================================
+//
+// Writes a command file to stdout. Every parameter is "key=value":
+//
+//   jobs=N        worker lines (default 10000)
+//   ops=N         basic commands per job (default 8)
+//   repeat=N      "repeat N" in the middle of every job, 0 = none (default 0)
+//   counters=N    counters used, ids 0..N-1 (default 16)
+//   skew=uniform|zipf   counter choice (default uniform)
+//   zipf_s=X      zipf exponent (default 1.0)
+//   msleep=R      fraction 0..1 of commands that are "msleep" (default 0)
+//   msleep_ms=N   length of each msleep (default 1)
+//   barrier=N     "dispatcher_wait" after every N jobs, 0 = none (default 0)
+//   seed=N        random seed (default 1)
+//
+// Same parameters, same file.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_GEN_COUNTERS  (1 << 24)   // MAX_COUNTERS in hw2
+
+static long   s_jobs      = 10000;
+static int    s_ops       = 8;
+static int    s_repeat    = 0;
+static int    s_counters  = 16;
+static int    s_zipf      = 0;
+static double s_zipf_s    = 1.0;
+static double s_msleep    = 0.0;
+static int    s_msleep_ms = 1;
+static long   s_barrier   = 0;
+static unsigned long long s_seed = 1;
+
+static double *s_cdf = NULL;   // zipf: P(id <= i), s_counters entries
+
+// xorshift64*: small, fast and the same on every machine
+static unsigned long long next_rand(void)
+{
+    s_seed ^= s_seed >> 12;
+    s_seed ^= s_seed << 25;
+    s_seed ^= s_seed >> 27;
+    return s_seed * 2685821657736338717ULL;
+}
+
+// Uniform in [0, 1)
+static double next_unit(void)
+{
+    return (double)(next_rand() >> 11) / 9007199254740992.0;
+}
+
+static int next_counter(void)
+{
+    if (!s_zipf)
+        return (int)(next_rand() % (unsigned long long)s_counters);
+
+    // Binary search of the zipf CDF
+    double u = next_unit();
+    int lo = 0, hi = s_counters - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (s_cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void put_op(void)
+{
+    if (s_msleep > 0 && next_unit() < s_msleep)
+        printf("msleep %d", s_msleep_ms);
+    else
+        printf("%s %d", (next_rand() & 3) ? "increment" : "decrement", next_counter());
+}
+
+static int parse_arg(const char *a)
+{
+    if      (strncmp(a, "jobs=", 5) == 0)      s_jobs      = atol(a + 5);
+    else if (strncmp(a, "ops=", 4) == 0)       s_ops       = atoi(a + 4);
+    else if (strncmp(a, "repeat=", 7) == 0)    s_repeat    = atoi(a + 7);
+    else if (strncmp(a, "counters=", 9) == 0)  s_counters  = atoi(a + 9);
+    else if (strcmp(a, "skew=uniform") == 0)   s_zipf      = 0;
+    else if (strcmp(a, "skew=zipf") == 0)      s_zipf      = 1;
+    else if (strncmp(a, "zipf_s=", 7) == 0)    s_zipf_s    = atof(a + 7);
+    else if (strncmp(a, "msleep=", 7) == 0)    s_msleep    = atof(a + 7);
+    else if (strncmp(a, "msleep_ms=", 10) == 0) s_msleep_ms = atoi(a + 10);
+    else if (strncmp(a, "barrier=", 8) == 0)   s_barrier   = atol(a + 8);
+    else if (strncmp(a, "seed=", 5) == 0)      s_seed      = strtoull(a + 5, NULL, 10);
+    else
+        return -1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (parse_arg(argv[i]) != 0) {
+            fprintf(stderr, "gen_cmdfile: unknown parameter %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (s_jobs < 0 || s_ops < 1 || s_repeat < 0 || s_counters < 1 ||
+        s_counters > MAX_GEN_COUNTERS || s_msleep < 0 || s_msleep > 1 ||
+        s_msleep_ms < 0 || s_barrier < 0) {
+        fprintf(stderr, "gen_cmdfile: parameter out of range\n");
+        return 1;
+    }
+    if (s_seed == 0)
+        s_seed = 1;
+
+    // Zipf: weight of counter i is 1 / (i + 1)^s
+    if (s_zipf) {
+        s_cdf = malloc(sizeof(double) * (size_t)s_counters);
+        if (!s_cdf) {
+            perror("gen_cmdfile: malloc");
+            return 1;
+        }
+        double sum = 0;
+        for (int i = 0; i < s_counters; i++) {
+            sum += 1.0 / pow((double)(i + 1), s_zipf_s);
+            s_cdf[i] = sum;
+        }
+        for (int i = 0; i < s_counters; i++)
+            s_cdf[i] /= sum;
+    }
+
+    for (long j = 0; j < s_jobs; j++) {
+        // Half the ops before the repeat, half in the loop body
+        int before = s_repeat ? s_ops / 2 : s_ops;
+
+        printf("worker ");
+        for (int k = 0; k < s_ops; k++) {
+            if (k > 0)
+                printf("; ");
+            if (s_repeat && k == before)
+                printf("repeat %d; ", s_repeat);
+            put_op();
+        }
+        printf("\n");
+
+        if (s_barrier > 0 && (j + 1) % s_barrier == 0)
+            printf("dispatcher_wait\n");
+    }
+    return 0;
+}
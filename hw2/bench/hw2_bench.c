@@ -0,0 +1,284 @@
+// ============================================================================
+// hw2_bench.c  — Run hw2 on a cmdfile across thread counts, print CSV
+// ============================================================================
+//
+// For every thread count, hw2 runs `runs` times in a scratch directory
+// (logging off); the fastest run is reported with the turnaround
+// percentiles from its stats.txt:
+//
+//   workload,threads,wall_s,jobs,ops,jobs_per_s,ops_per_s,
+//   turnaround_p50_ms,turnaround_p90_ms,turnaround_p99_ms,turnaround_p999_ms,
+//   lock_contended,lock_wait_ms,lock_handoffs,queue_locks_per_job,wal_commits
+//
+// jobs = worker lines in the cmdfile, ops = "worker ops requested" (basic
+// commands with repeats expanded). The lock columns come from metrics.txt
+// and are only filled in for a METRICS=1 build of hw2 (else -1):
+// counter mutex contention, and job queue mutex acquisitions per job.
+// wal_commits is the number of fdatasyncs of a durable=on run (else -1).
+//
+// Usage: hw2_bench <cmdfile> [hw2=./hw2] [name=workload] [threads=1,2,4,8]
+//                  [counters=100] [runs=1] [header=1] [dir=/tmp]
+//                  [-- hw2 options...]
+// (the parameters may come in any order, before "--"). The scratch
+// directory is made in dir; durable=on wants one on a real disk (a
+// tmpfs /tmp makes fdatasync free).
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define MAX_COUNTS   32
+#define MAX_OPTIONS  32
+
+typedef struct Result {
+    double    wall_s;
+    long long ops;
+    double    p[4];       // turnaround p50/p90/p99/p99.9 in ms
+    long long contended;  // metrics.txt "lock wait" events, -1 if none
+    double    lock_wait_ms;
+    long long handoffs;
+    long long queue_locks;
+    long long wal_commits;  // stats.txt "wal group commits", -1 if none
+} Result;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Worker lines in the file
+static long count_jobs(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("fopen");
+        return -1;
+    }
+    long jobs = 0;
+    int at_start = 1, c, k = 0;
+    static const char word[] = "worker";
+    while ((c = fgetc(f)) != EOF) {
+        if (c == '\n') {
+            at_start = 1;
+            k = 0;
+        } else if (at_start) {
+            if (c == word[k]) {
+                if (++k == 6) {
+                    jobs++;
+                    at_start = 0;
+                }
+            } else {
+                at_start = 0;
+            }
+        }
+    }
+    fclose(f);
+    return jobs;
+}
+
+// Pick the numbers we report out of stats.txt
+static int read_stats(Result *r)
+{
+    FILE *f = fopen("stats.txt", "r");
+    if (!f) {
+        perror("stats.txt");
+        return -1;
+    }
+    char line[512];
+    int found = 0;
+    r->wal_commits = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "worker ops requested: %lld", &r->ops) == 1)
+            found |= 1;
+        else if (sscanf(line, "job turnaround time p50/p90/p99/p99.9: %lf / %lf / %lf / %lf",
+                        &r->p[0], &r->p[1], &r->p[2], &r->p[3]) == 4)
+            found |= 2;
+        else if (sscanf(line, "wal group commits: %lld", &r->wal_commits) == 1)
+            continue;
+    }
+    fclose(f);
+    if (found != 3)
+        return -1;
+
+    // METRICS=1 build: contended counter locks
+    r->contended    = -1;
+    r->lock_wait_ms = -1;
+    r->handoffs     = -1;
+    r->queue_locks  = -1;
+    f = fopen("metrics.txt", "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, " lock wait %lf ms %lld times",
+                       &r->lock_wait_ms, &r->contended) == 2)
+                continue;
+            if (sscanf(line, " counter lock handoffs (another thread had it last): %lld",
+                       &r->handoffs) == 1)
+                continue;
+            if (sscanf(line, " queue lock acquisitions: %lld", &r->queue_locks) == 1)
+                break;
+        }
+        fclose(f);
+    }
+    return 0;
+}
+
+static int run_once(const char *hw2, const char *cmdfile, int threads,
+                    const char *counters, char **options, int num_options,
+                    Result *r)
+{
+    char nthreads[16];
+    snprintf(nthreads, sizeof(nthreads), "%d", threads);
+
+    char *args[MAX_OPTIONS + 6];
+    int n = 0;
+    args[n++] = (char *)hw2;
+    args[n++] = (char *)cmdfile;
+    args[n++] = nthreads;
+    args[n++] = (char *)counters;
+    args[n++] = "0";
+    for (int i = 0; i < num_options; i++)
+        args[n++] = options[i];
+    args[n] = NULL;
+
+    // Every run starts from zero (durable=on would recover the last one)
+    unlink("metrics.txt");
+    unlink("counters.wal");
+    unlink("counters.snap");
+
+    long long t0 = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execv(hw2, args);
+        perror("execv");
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return -1;
+    }
+    r->wall_s = (double)(now_ns() - t0) / 1e9;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "hw2_bench: hw2 failed with %d threads\n", threads);
+        return -1;
+    }
+    return read_stats(r);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *cmd_arg = NULL;
+    const char *hw2_arg = "./hw2", *name = "workload", *counters = "100";
+    const char *scratch = "/tmp";
+    char threads_arg[256] = "1,2,4,8";
+    int runs = 1, header = 1;
+    char **options = NULL;
+    int num_options = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            options = &argv[i + 1];
+            num_options = argc - i - 1;
+            break;
+        }
+        if      (strncmp(argv[i], "hw2=", 4) == 0)      hw2_arg  = argv[i] + 4;
+        else if (strncmp(argv[i], "name=", 5) == 0)     name     = argv[i] + 5;
+        else if (strncmp(argv[i], "counters=", 9) == 0) counters = argv[i] + 9;
+        else if (strncmp(argv[i], "runs=", 5) == 0)     runs     = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "header=", 7) == 0)   header   = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "dir=", 4) == 0)      scratch  = argv[i] + 4;
+        else if (strncmp(argv[i], "threads=", 8) == 0)
+            snprintf(threads_arg, sizeof(threads_arg), "%s", argv[i] + 8);
+        else if (!strchr(argv[i], '=') && !cmd_arg)
+            cmd_arg = argv[i];
+        else {
+            fprintf(stderr, "hw2_bench: unknown parameter %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!cmd_arg) {
+        fprintf(stderr, "Usage: hw2_bench <cmdfile> [hw2=./hw2] [name=workload] [threads=1,2,4,8]\n"
+                        "                 [counters=100] [runs=1] [header=1] [dir=/tmp]\n"
+                        "                 [-- hw2 options...]\n");
+        return 1;
+    }
+    if (runs < 1 || num_options > MAX_OPTIONS) {
+        fprintf(stderr, "hw2_bench: bad runs or too many hw2 options\n");
+        return 1;
+    }
+
+    // Thread counts
+    int counts[MAX_COUNTS], num_counts = 0;
+    for (char *tok = strtok(threads_arg, ","); tok && num_counts < MAX_COUNTS;
+         tok = strtok(NULL, ","))
+        counts[num_counts++] = atoi(tok);
+
+    // Absolute paths: we run in a scratch directory
+    char hw2[PATH_MAX], cmdfile[PATH_MAX];
+    if (!realpath(hw2_arg, hw2) || !realpath(cmd_arg, cmdfile)) {
+        perror("realpath");
+        return 1;
+    }
+    long jobs = count_jobs(cmdfile);
+    if (jobs < 0)
+        return 1;
+
+    char dir[PATH_MAX + 32], base[PATH_MAX];
+    if (!realpath(scratch, base)) {
+        perror(scratch);
+        return 1;
+    }
+    snprintf(dir, sizeof(dir), "%s/hw2_bench.XXXXXX", base);
+    if (!mkdtemp(dir) || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    if (header)
+        printf("workload,threads,wall_s,jobs,ops,jobs_per_s,ops_per_s,"
+               "turnaround_p50_ms,turnaround_p90_ms,turnaround_p99_ms,turnaround_p999_ms,"
+               "lock_contended,lock_wait_ms,lock_handoffs,queue_locks_per_job,wal_commits\n");
+
+    int rc = 0;
+    for (int i = 0; i < num_counts && rc == 0; i++) {
+        Result best = { 0 };
+        for (int k = 0; k < runs; k++) {
+            Result r;
+            if (run_once(hw2, cmdfile, counts[i], counters, options, num_options, &r) != 0) {
+                rc = 1;
+                break;
+            }
+            if (k == 0 || r.wall_s < best.wall_s)
+                best = r;
+        }
+        if (rc)
+            break;
+
+        double qlocks = (best.queue_locks >= 0 && jobs > 0)
+                        ? (double)best.queue_locks / (double)jobs : -1;
+        printf("%s,%d,%.4f,%ld,%lld,%.0f,%.0f,%.3f,%.3f,%.3f,%.3f,%lld,%.3f,%lld,%.3f,%lld\n",
+               name, counts[i], best.wall_s, jobs, best.ops,
+               (double)jobs / best.wall_s, (double)best.ops / best.wall_s,
+               best.p[0], best.p[1], best.p[2], best.p[3],
+               best.contended, best.lock_wait_ms, best.handoffs, qlocks,
+               best.wal_commits);
+        fflush(stdout);
+    }
+
+    // Leave nothing behind
+    if (system("rm -f *.txt counters.bin counters.wal counters.snap") != 0)
+        fprintf(stderr, "hw2_bench: could not clean %s\n", dir);
+    if (chdir("/") != 0 || rmdir(dir) != 0)
+        fprintf(stderr, "hw2_bench: could not remove %s\n", dir);
+    return rc;
+}
@@ -0,0 +1,113 @@
+// ============================================================================
+// pool_bench.c  — Startup time and memory of hw2 for growing num_threads
+// ============================================================================
+//
+// Runs the hw2 binary on two small command files, once per thread count,
+// in a scratch directory, and reports the wall time and the peak RSS of
+// the child (wait4 rusage):
+//
+//   tiny    two trivial jobs (pure startup/shutdown cost)
+//   burst   200 jobs sleeping 20 ms (the pool has to grow)
+//
+// Usage: pool_bench [path/to/hw2]
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int write_cmdfile(const char *path, int jobs, const char *line)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("fopen");
+        return -1;
+    }
+    for (int i = 0; i < jobs; i++)
+        fprintf(f, "%s\n", line);
+    fclose(f);
+    return 0;
+}
+
+// Run hw2 once; *ms gets the wall time, *rss_kb the child's peak RSS
+static int run(const char *hw2, const char *cmdfile, int threads,
+               double *ms, long *rss_kb)
+{
+    char nthreads[16];
+    snprintf(nthreads, sizeof(nthreads), "%d", threads);
+
+    long long t0 = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execl(hw2, hw2, cmdfile, nthreads, "4", "0", (char *)NULL);
+        perror("execl");
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        perror("wait4");
+        return -1;
+    }
+    *ms     = (double)(now_ns() - t0) / 1e6;
+    *rss_kb = ru.ru_maxrss;
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    char hw2[PATH_MAX];
+    if (!realpath((argc > 1) ? argv[1] : "./hw2", hw2)) {
+        fprintf(stderr, "Usage: pool_bench [path/to/hw2]\n");
+        return 1;
+    }
+
+    // Scratch directory for the command files and hw2's output files
+    char dir[] = "/tmp/pool_bench.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (write_cmdfile("tiny.txt", 2, "worker increment 0") != 0 ||
+        write_cmdfile("burst.txt", 200, "worker msleep 20; increment 1") != 0)
+        return 1;
+
+    static const int counts[] = { 1, 16, 256, 1024, 4096 };
+
+    printf("%7s %12s %12s %12s %12s\n", "threads",
+           "tiny ms", "tiny RSS KB", "burst ms", "burst RSS KB");
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        double tiny_ms, burst_ms;
+        long tiny_rss, burst_rss;
+        if (run(hw2, "tiny.txt", counts[i], &tiny_ms, &tiny_rss) != 0 ||
+            run(hw2, "burst.txt", counts[i], &burst_ms, &burst_rss) != 0) {
+            fprintf(stderr, "pool_bench: hw2 failed with %d threads\n", counts[i]);
+            return 1;
+        }
+        printf("%7d %12.1f %12ld %12.1f %12ld\n",
+               counts[i], tiny_ms, tiny_rss, burst_ms, burst_rss);
+    }
+
+    // Leave nothing behind
+    if (system("rm -f *.txt counters.bin") != 0)
+        fprintf(stderr, "pool_bench: could not clean %s\n", dir);
+    if (chdir("/") != 0 || rmdir(dir) != 0)
+        fprintf(stderr, "pool_bench: could not remove %s\n", dir);
+    return 0;
+}
@@ -0,0 +1,44 @@
+// ============================================================================
+// arena.h  — Job allocation: slab pool for Job nodes, bump arena for the
+//            line text and op arrays
+// ============================================================================
+//
+// Only the dispatcher allocates; workers release. Job nodes come from
+// slabs of JOB_SLAB_SIZE and go back on a free list. Line/op storage is
+// bump-allocated from 64 KB chunks. Each chunk counts the jobs still
+// using it and is recycled as a whole when that count drops to zero; at a
+// dispatcher_wait barrier the current chunk is rewound too.
+//
+// "alloc=malloc" keeps the old malloc/strdup/free behaviour.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include "func.h"
+
+#define ALLOC_MALLOC  0
+#define ALLOC_ARENA   1
+
+#define JOB_SLAB_SIZE     256
+#define ARENA_CHUNK_SIZE  (64 * 1024)
+
+extern int g_alloc_mode;   // ALLOC_MALLOC / ALLOC_ARENA
+
+// Free every slab and chunk (shutdown, after the workers are joined)
+void arena_destroy(void);
+
+// Dispatcher: a new Job holding a copy of ops[0 .. num_ops) and of
+// line[0 .. len) (NUL-terminated). With copy_line == 0 the job points at
+// line itself, which must outlive it (arena mode only; malloc mode always
+// copies). Other Job fields are left to the caller.
+Job *job_alloc(const char *line, size_t len, int copy_line,
+               const Op *ops, int num_ops);
+
+// Any thread: the job is finished, give its memory back
+void job_free(Job *job);
+
+// Dispatcher, at a barrier (no job in flight): recycle everything
+void arena_reset(void);
+
+#endif
@@ -0,0 +1,88 @@
+// ============================================================================
+// counters.h  — In-memory counter store backed by one memory-mapped file
+// ============================================================================
+//
+// counters.bin is the store: one fixed-width record (a native long long)
+// per counter, counter cid at offset cid * 8. It is sized with ftruncate
+// and never written through, so init costs the same for 10 counters or
+// 10 million, and any counter is one index away.
+//
+// Update modes ("counters=..." on the command line):
+//
+//   atomic  an add is one fetch-add with no mutex (default). Up to
+//           COUNTER_PAD_MAX counters the atomics are cache-line padded
+//           (copied into the mapping at every sync); beyond that they
+//           are the mapped records themselves.
+//   lock    every add takes the stripe mutex g_counter_mutex[cid mod
+//           COUNTER_STRIPES] and updates the mapped record
+//   delta   each worker adds into a small private table; tables are
+//           merged into the atomics when full, when the worker goes idle
+//           and at every sync
+//
+// The legacy text files countNN.txt are written by counter_store_sync(),
+// which runs at every dispatcher_wait barrier and at shutdown (the only
+// points where counter values are observable), when "export=text" asks
+// for them. The default "export=auto" writes them for up to
+// EXPORT_TEXT_MAX counters only. tools/counter_export writes them from a
+// counters.bin afterwards.
+//
+// counters.bin is rewritten from zero by every run. With "durable=on" the
+// store starts from the last run's values instead and every update is
+// logged first (see wal.h).
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <pthread.h>
+#include "futex.h"   // CACHE_LINE
+
+#define COUNTER_STORE_FILE  "counters.bin"
+
+#define COUNTERS_ATOMIC  0
+#define COUNTERS_LOCK    1
+#define COUNTERS_DELTA   2
+
+#define EXPORT_AUTO  0
+#define EXPORT_TEXT  1
+#define EXPORT_NONE  2
+
+#define COUNTER_STRIPES  1024      // lock mode mutexes (power of two)
+#define COUNTER_STRIPE(cid)  ((cid) & (COUNTER_STRIPES - 1))
+#define COUNTER_PAD_MAX  4096      // padded atomics up to this many counters
+#define EXPORT_TEXT_MAX  100       // export=auto: text files up to this many
+
+extern int g_counter_mode;   // COUNTERS_ATOMIC / COUNTERS_LOCK / COUNTERS_DELTA
+extern int g_export_mode;    // EXPORT_AUTO / EXPORT_TEXT / EXPORT_NONE
+
+// A mutex alone on its cache line, so neighbours do not false-share
+typedef struct PaddedMutex {
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;
+} PaddedMutex;
+
+// COUNTER_STRIPES mutexes, lock mode only (defined in main.c). With
+// fewer counters than stripes every counter has a mutex of its own.
+extern PaddedMutex g_counter_mutex[];
+
+// Create counters.bin (all zero) and map it; with text export also create
+// countNN.txt files holding "0". num_workers sizes the delta tables.
+int counter_store_init(int num_counters, int num_workers);
+
+// Worker worker_id adds delta to counter cid (cid must be in range)
+void counter_add(int worker_id, int cid, long long delta);
+
+// Read the current value of counter cid (merged deltas only)
+long long counter_get(int cid);
+
+// Merge worker_id's delta buffer into the store (delta mode; no-op else)
+void counter_flush_worker(int worker_id);
+
+// Merge every delta table and bring counters.bin up to date, then (text
+// export) write every counter that changed since the last sync to
+// countNN.txt. Must be called when no job is in flight (barrier /
+// shutdown).
+int counter_store_sync(void);
+
+// Unmap and close the store
+void counter_store_close(void);
+
+#endif
@@ -13,19 +13,61 @@
 #include <time.h>
 #include <errno.h>
 #include <ctype.h>   // for isspace()
+#include <limits.h>
 
-#define MAX_LINE      1024
-#define MAX_COUNTERS  100
+#define MAX_COUNTERS  (1 << 24)   // counters.bin records (see counters.h)
 #define MAX_THREADS   4096
 
+#define PRIO_CLASSES  4           // "priority 0" (most urgent) .. 3
+#define PRIO_DEFAULT  2           // lines without "priority"
+#define NO_DEADLINE   LLONG_MAX   // Job::due_ns of lines without "deadline"
+
 /* --------------------------------------------------------------------------
    Structures
    -------------------------------------------------------------------------- */
 
+// One basic worker command, decoded once by the dispatcher
+typedef enum OpCode {
+    OP_MSLEEP,                // arg = milliseconds
+    OP_ADD                    // arg = counter id, delta = amount to add
+} OpCode;
+
+typedef struct Op {
+    int code;                 // OpCode
+    int arg;                  // operand
+    long long delta;          // OP_ADD only (+1 / -1, or a folded sum)
+} Op;
+
 // One job = one full "worker ..." line read by the dispatcher
 typedef struct Job {
-    char *line;               // malloc'ed copy of the line
-    long long read_time_ms;   // time dispatcher read/enqueued this job
+    const char *line;         // the line, not NUL-terminated (see arena.h)
+    size_t line_len;
+    long long read_time_ns;   // time dispatcher read/enqueued this job
+    unsigned int id;          // number of the line in the command file
+
+    // Decoded program: ops[0 .. repeat_start) run once, then
+    // ops[repeat_start .. num_ops) run repeat_times times.
+    Op  *ops;
+    int  num_ops;
+    int  repeat_start;
+    int  repeat_times;
+
+    // Progress, so a job suspended at an msleep can resume (timer.h)
+    int  pc;                  // next op to run
+    int  iter_left;           // loop body passes still to run
+    int  started;             // START logged, start_ns valid
+    long long start_ns;
+    long long wake_ns;        // when a suspended job is due (ns since start)
+
+    int  route;               // counter-affinity ticket, -1: none (queue.h)
+
+    // Scheduling annotations (sched=prio|edf|sjf, see queue.h)
+    int  prio;                // priority class, 0 = most urgent
+    int  deadline_ms;         // due this long after it is read, -1: none
+    long long due_ns;         // read_time_ns + deadline, or NO_DEADLINE
+    long long cost_ns;        // estimated run time (parse.h job_cost_ns)
+
+    struct ArenaChunk *chunk; // arena chunk holding line/ops (NULL: malloc'ed)
     struct Job *next;         // linked-list queue pointer
 } Job;
 
@@ -33,31 +75,26 @@ typedef struct Job {
 typedef struct JobQueue {
     Job *head;
     Job *tail;
+    int length;               // jobs in the list
+    int sleepers;             // workers waiting on has_jobs
     pthread_mutex_t mutex;    // protects access to queue
     pthread_cond_t  has_jobs; // workers sleep here if queue empty
 } JobQueue;
 
-// Statistics about job turnaround time
+// Dispatcher-side statistics (job latencies are per worker, see stats.h)
 typedef struct Stats {
-    long long sum_turnaround_ms;
-    long long min_turnaround_ms;
-    long long max_turnaround_ms;
-    long long job_count;
-    pthread_mutex_t mutex;    // protects stats updates
+    // Written by the dispatcher only (no lock needed)
+    long long ops_requested;  // basic commands the job lines stand for
+    long long ops_eliminated; // removed by folding (see optimize_job)
 } Stats;
 
 /* --------------------------------------------------------------------------
    Global variables (defined in func.c, only declared here)
    -------------------------------------------------------------------------- */
 
-extern JobQueue g_job_queue;
 extern Stats    g_stats;
 
-extern long long g_start_time_ms;
-
-extern int g_jobs_in_progress;
-extern pthread_mutex_t g_jobs_mutex;
-extern pthread_cond_t  g_jobs_zero_cond;
+extern long long g_start_time_ns;
 
 extern int g_dispatcher_done;
 
@@ -65,9 +102,8 @@ extern int g_log_enabled;
 extern int g_num_counters;
 extern int g_num_threads;
 
-/* *** IMPORTANT ***  
-   We also must declare the counter mutex array here,
-   because func.c defines it AND worker_thread_main() uses it.
+/* The counter store (atomic, striped-lock and delta modes) and its
+   stripe mutexes g_counter_mutex[] are declared in counters.h.
 */
 
 
@@ -75,10 +111,12 @@ extern int g_num_threads;
    Time helpers
    -------------------------------------------------------------------------- */
 
-// Return current time (ms)
+// Return current time (ns / ms, CLOCK_MONOTONIC)
+long long now_ns(void);
 long long now_ms(void);
 
-// Return milliseconds since program start
+// Return nanoseconds / milliseconds since program start
+long long since_start_ns(void);
 long long since_start_ms(void);
 
 /* --------------------------------------------------------------------------
@@ -97,16 +135,37 @@ void report_syscall_error(const char *syscall_name);
 
 int init_system(int num_threads, int num_counters, int log_enabled);
 
+// Worker-side hook: the queue calls it just before worker_id sleeps
+void worker_going_idle(int worker_id);
+
 void shutdown_system(void);
 
 /* --------------------------------------------------------------------------
    Dispatcher-side helpers
    -------------------------------------------------------------------------- */
 
-int enqueue_job(const char *line, long long read_time_ms);
+// Parse line[0 .. len) and queue it (see flush_jobs). If line_stable,
+// the text outlives the job (mapped command file) and is not copied.
+// Returns 0 on success, 1 if the line was rejected as malformed (a
+// warning is printed), -1 on allocation failure.
+int enqueue_job(const char *line, size_t len, int line_stable,
+                long long read_time_ns, unsigned int id);
+
+// The two halves of enqueue_job, for read-ahead across a barrier:
+// build_job parses and allocates (NULL if the line is malformed or memory
+// runs out; nothing is printed), submit_job stamps and queues it later.
+Job *build_job(const char *line, size_t len, int line_stable, unsigned int id);
+int  submit_job(Job *job, long long read_time_ns);
+
+// Queued jobs are handed to the workers in blocks (queue.h batch=N);
+// flush_jobs hands over a partial block now. dispatcher_wait_for_all_jobs
+// flushes first.
+int  flush_jobs(void);
 
 void dispatcher_wait_for_all_jobs(void);
 
-int write_stats_file(const char *filename);
+// The stats.txt lines. Only when no job is in flight (barrier / exit).
+void write_stats(FILE *f);
+int  write_stats_file(const char *filename);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+// ============================================================================
+// futex.h  — Minimal futex wrappers (Linux) used by the lock-free queues
+//            and the logger
+// ============================================================================
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_LINE 64
+
+// Sleep while *addr == expected (returns at once if it already changed)
+static inline void futex_wait(_Atomic unsigned int *addr, unsigned int expected)
+{
+    syscall(SYS_futex, (unsigned int *)addr, FUTEX_WAIT_PRIVATE, expected,
+            NULL, NULL, 0);
+}
+
+// Same, but give up after ms milliseconds
+static inline void futex_wait_ms(_Atomic unsigned int *addr, unsigned int expected,
+                                 int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    syscall(SYS_futex, (unsigned int *)addr, FUTEX_WAIT_PRIVATE, expected,
+            &ts, NULL, 0);
+}
+
+// Same, but give up after ns nanoseconds
+static inline void futex_wait_ns(_Atomic unsigned int *addr, unsigned int expected,
+                                 long long ns)
+{
+    struct timespec ts = { (time_t)(ns / 1000000000LL), (long)(ns % 1000000000LL) };
+    syscall(SYS_futex, (unsigned int *)addr, FUTEX_WAIT_PRIVATE, expected,
+            &ts, NULL, 0);
+}
+
+// Wake up to n threads sleeping on addr
+static inline void futex_wake(_Atomic unsigned int *addr, int n)
+{
+    syscall(SYS_futex, (unsigned int *)addr, FUTEX_WAKE_PRIVATE, n,
+            NULL, NULL, 0);
+}
+
+#endif
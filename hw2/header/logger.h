@@ -0,0 +1,56 @@
+// ============================================================================
+// logger.h  — dispatcher.txt / threadNN.txt logging
+// ============================================================================
+//
+// Every log file ("sink") has exactly one producer: worker N writes
+// threadNN.txt, the dispatcher writes dispatcher.txt.
+//
+//   log=async  (default) the producer copies the event into a lock-free
+//              ring of its own; one logger thread drains all rings every
+//              few ms, formats the lines and writes each file with one
+//              large write()
+//   log=sync   one formatted write() per event, like the old
+//              fprintf + fflush
+//   log=binary same rings, but the producer stores a 16-byte record
+//              (worker, job id, event, ns timestamp) instead of text and
+//              the logger appends raw frames to trace.bin (see trace.h).
+//              tools/trace_decode turns it back into the text files or
+//              into Chrome-trace JSON.
+//
+// The text files are the same in async and sync mode.
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stddef.h>
+
+#define LOG_SYNC    0
+#define LOG_ASYNC   1
+#define LOG_BINARY  2
+
+#define LOG_READ   0   // "TIME t: read cmd line: <line>"
+#define LOG_START  1   // "TIME t: START job <line>"
+#define LOG_END    2   // "TIME t: END job <line>"
+
+#define LOG_RING_SIZE   (64 * 1024)   // bytes per sink, power of two
+#define LOG_FLUSH_MS    10            // logger wakes up at least this often
+
+extern int g_log_mode;   // LOG_SYNC / LOG_ASYNC / LOG_BINARY
+
+// Open dispatcher.txt and thread00.txt .. thread<n-1>.txt (trace.bin in
+// binary mode), start the logger thread (async/binary mode)
+int logger_init(int num_workers);
+
+// Producers. Times are ns since program start; job_id identifies the
+// line (the dispatcher numbers the lines it reads); the line is the slice
+// line[0 .. len), no NUL needed.
+void log_dispatcher(long long time_ns, unsigned int job_id,
+                    const char *line, size_t len);
+void log_worker(int worker_id, int type, long long time_ns,
+                unsigned int job_id, const char *line, size_t len);
+
+// Drain everything, stop the logger thread and close the files.
+// Call after the workers are joined.
+void logger_close(void);
+
+#endif
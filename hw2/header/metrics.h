@@ -0,0 +1,81 @@
+// ============================================================================
+// metrics.h  — Optional per-thread phase timers and counter lock stats
+// ============================================================================
+//
+// Compiled in only with -DHW2_METRICS (make METRICS=1); otherwise every
+// macro below is empty and the hot path is unchanged.
+//
+// Every thread adds into its own slot (workers 0..N-1, then the
+// dispatcher, the logger thread and the timer thread), so recording
+// takes no lock and shares no cache line. main writes metrics.txt at
+// exit:
+//
+//   queue wait  worker blocked in queue_pop waiting for a job
+//   parse       dispatcher parsing/folding a worker line
+//   lock wait   time blocked on a busy counter stripe mutex (lock mode)
+//   execute     worker running a job's ops (lock wait included)
+//   file I/O    countNN.txt/stats.txt writes and log writes
+//
+// plus the number of queue mutex acquisitions (list/steal modes; see
+// queue.h batch=N), and, per counter stripe (see counters.h), how often
+// its mutex was taken, how often it was already held (contended), how
+// long the waits were, and how often it was taken by another thread than
+// the last one (handoffs: the mutex's cache line moved).
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#define MET_QUEUE_WAIT  0
+#define MET_PARSE       1
+#define MET_LOCK_WAIT   2
+#define MET_EXEC        3
+#define MET_FILE_IO     4
+#define NUM_METRICS     5
+
+#define METRICS_FILE    "metrics.txt"
+
+// Slots of the non-worker threads (stored after the workers')
+#define MET_DISPATCHER  (-1)
+#define MET_LOGGER      (-2)
+#define MET_TIMER       (-3)
+
+#ifdef HW2_METRICS
+
+#include <pthread.h>
+
+int  metrics_init(int num_workers, int num_counters);
+
+// Slot (worker id or MET_DISPATCHER/MET_LOGGER) adds ns to a phase and
+// counts one event
+void metrics_add(int slot, int phase, long long ns);
+
+// Slot takes the stripe mutex m of counter cid, timing the wait if it
+// is held
+void metrics_mutex_lock(pthread_mutex_t *m, int slot, int cid);
+
+// Slot takes a job queue mutex (counted, not timed)
+void metrics_queue_lock(pthread_mutex_t *m, int slot);
+
+int  metrics_write(const char *filename);
+void metrics_destroy(void);
+
+// Time a block: METRICS_START(t); ...; METRICS_STOP(slot, phase, t);
+#define METRICS_START(t)              long long t = now_ns()
+#define METRICS_STOP(slot, phase, t)  metrics_add((slot), (phase), now_ns() - (t))
+#define METRICS_LOCK(m, slot, cid)    metrics_mutex_lock((m), (slot), (cid))
+#define METRICS_QLOCK(m, slot)        metrics_queue_lock((m), (slot))
+
+#else
+
+#define metrics_init(num_workers, num_counters)  0
+#define metrics_write(filename)                  0
+#define metrics_destroy()                        ((void)0)
+
+#define METRICS_START(t)              ((void)0)
+#define METRICS_STOP(slot, phase, t)  ((void)0)
+#define METRICS_LOCK(m, slot, cid)    ((void)(slot), (void)(cid), pthread_mutex_lock(m))
+#define METRICS_QLOCK(m, slot)        ((void)(slot), pthread_mutex_lock(m))
+
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+// ============================================================================
+// parse.h  — Turn a "worker ..." line into a decoded op program
+// ============================================================================
+
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stddef.h>
+#include "func.h"
+
+// Is the slice [p, p + n) exactly the string s? (command line matching)
+int slice_is(const char *p, size_t n, const char *s);
+
+// Does the slice [p, p + n) start with the string s?
+int slice_starts(const char *p, size_t n, const char *s);
+
+// Decode line[0 .. len) into job->ops / num_ops / repeat_start / repeat_times.
+// job->ops points into a scratch buffer owned by the parser; it stays valid
+// until the next parse_job_line / optimize_job call. Dispatcher thread only.
+//
+// Increment/decrement of a counter outside [0, num_counters) compile to
+// nothing, like before. "priority P" (0 .. PRIO_CLASSES-1) and
+// "deadline D" (ms after the line is read) are annotations, not ops:
+// they set job->prio / job->deadline_ms (else PRIO_DEFAULT / -1).
+// Returns 0 on success, or -1 if the line is malformed; then job->ops is
+// NULL and err holds the offending command.
+int parse_job_line(const char *line, size_t len, int num_counters,
+                   Job *job, char *err, size_t err_size);
+
+// Fold the job's counter ops into net per-counter deltas (see parse.c).
+// job->ops is replaced by another scratch buffer. Returns how many
+// executed ops were eliminated.
+long long optimize_job(Job *job);
+
+// Number of basic commands the job executes (repeat expanded)
+long long job_op_count(const Job *job);
+
+// Estimated run time of the job in ns (repeat expanded): its msleeps,
+// plus JOB_OP_COST_NS per counter op. sched=sjf orders by it.
+#define JOB_OP_COST_NS  20
+long long job_cost_ns(const Job *job);
+
+#endif
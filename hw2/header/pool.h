@@ -0,0 +1,40 @@
+// ============================================================================
+// pool.h  — Elastic worker pool
+// ============================================================================
+//
+// init_system starts only POOL_MIN_WORKERS workers. Every time the
+// dispatcher is about to queue a block of jobs it checks the in-flight
+// count: while the jobs in flight (less those sleeping on the timer
+// wheel, msleep=timer) plus the block outnumber the workers, one more
+// worker is started, up to num_threads. The new workers are there before
+// the block is, so it is spread over all of them. A tiny cmdfile run with
+// num_threads=4096 therefore starts one or two threads, not 4096.
+// queue=steal place=counter starts all of them at once: it ties each
+// counter to one worker for the whole run.
+//
+// Workers get a WORKER_STACK_SIZE stack instead of the 8 MB default (they
+// only run the op interpreter). An idle worker parks on the queue's
+// condvar/futex and costs no CPU; workers are never retired before
+// shutdown, so worker ids (and their log files, histograms and counter
+// deltas) stay fixed.
+
+#ifndef POOL_H
+#define POOL_H
+
+#define POOL_MIN_WORKERS   1
+#define WORKER_STACK_SIZE  (256 * 1024)
+
+// Start the first workers running worker_main((void *)(long)id)
+int  pool_init(void *(*worker_main)(void *));
+
+// Dispatcher, before queue_push_batch of n jobs: start workers while the
+// jobs in flight plus n outnumber them
+void pool_jobs_coming(int n);
+
+// Workers started so far (any thread; it only grows)
+int  pool_size(void);
+
+// Join every started worker (after queue_close)
+void pool_join(void);
+
+#endif
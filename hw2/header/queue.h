@@ -0,0 +1,124 @@
+// ============================================================================
+// queue.h  — Job queue between the dispatcher and the workers
+// ============================================================================
+//
+// Three implementations, chosen on the command line with "queue=...":
+//
+//   list   mutex + condvar linked list (default)
+//   ring   lock-free bounded MPMC ring; threads sleep on a futex only when
+//          the ring is empty (workers) or full (dispatcher)
+//   steal  one deque per worker, idle workers steal from peers. Jobs are
+//          placed round-robin ("place=rr") or by counter ("place=counter")
+//
+// place=counter: each job gets the ticket of the counter it updates most
+// often (queue_route), and ticket t goes to worker t % num_threads. Jobs on
+// the same counter run on one worker, one after the other, instead of
+// fighting over its mutex/cache line on several cores; distinct counters
+// get distinct tickets, so disjoint jobs spread out. To keep that, a job
+// wakes the worker it was routed to, and a thief only steals from a
+// worker once AFFINITY_STEAL_MIN jobs are waiting there.
+//
+// All of them also count the jobs in flight (queued or running) for the
+// dispatcher_wait barrier.
+//
+// Batches ("batch=N", default QUEUE_BATCH_DEFAULT, batch=1: one job at a
+// time): the dispatcher hands over parsed jobs in blocks of N, each
+// queued with one lock round trip (per deque in steal mode), one
+// in-flight update and one wakeup sized to the block. A worker takes up
+// to N jobs per dequeue: its share of the queued jobs (queue depth /
+// num_threads; half of its own deque in steal mode), so a short queue is
+// still spread over all workers, and no more than QUEUE_BATCH_COST_NS of
+// estimated work (parse.h job_cost_ns), so jobs that msleep are not run
+// one after the other by one worker. It reports them done in one update.
+//
+// Scheduling ("sched=...", list mode only): by default the list is FIFO.
+// With sched=prio|edf|sjf it is a binary heap under the same mutex and a
+// worker takes one job at a time (the best one right now, so a job that
+// arrives later can still overtake the rest). Jobs are ordered by their
+// "priority" class first (multi-level queues; a lower class waits while a
+// higher one has jobs), then inside a class:
+//
+//   prio  in arrival order
+//   edf   earliest deadline first ("deadline D": D ms after the line was
+//         read; jobs without one come after those with one)
+//   sjf   shortest estimated run time first (parse.h job_cost_ns)
+//
+// Ties keep arrival order. A resumed job (msleep=timer) keeps its place.
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "func.h"
+
+#define QUEUE_LIST  0
+#define QUEUE_RING  1
+#define QUEUE_STEAL 2
+
+#define PLACE_RR       0
+#define PLACE_COUNTER  1
+
+#define SCHEDULE_FIFO  0
+#define SCHEDULE_PRIO  1
+#define SCHEDULE_EDF   2
+#define SCHEDULE_SJF   3
+
+#define DEFAULT_RING_SIZE  4096
+
+#define AFFINITY_STEAL_MIN  8
+
+#define QUEUE_BATCH_DEFAULT  32
+#define QUEUE_BATCH_MAX      256
+#define QUEUE_BATCH_COST_NS  1000000LL   // 1 ms of estimated work
+
+// List mode state (defined in queue.c)
+extern JobQueue g_job_queue;
+extern int g_jobs_in_progress;
+extern pthread_mutex_t g_jobs_mutex;
+extern pthread_cond_t  g_jobs_zero_cond;
+
+extern int g_queue_mode;   // QUEUE_LIST / QUEUE_RING / QUEUE_STEAL
+extern int g_ring_size;    // ring capacity (rounded up to a power of two)
+extern int g_place_mode;   // PLACE_RR / PLACE_COUNTER (steal mode)
+extern int g_queue_batch;  // jobs per push/pop block, 1 .. QUEUE_BATCH_MAX
+extern int g_sched_mode;   // SCHEDULE_FIFO / SCHEDULE_PRIO / SCHEDULE_EDF / SCHEDULE_SJF
+
+int  queue_init(void);
+void queue_destroy(void);
+
+// Dispatcher: routing ticket of a parsed job (place=counter with
+// queue=steal), else -1
+int queue_route(const Job *job);
+
+// Dispatcher: add a NULL-terminated list of jobs (job->next), in blocks
+// of g_queue_batch, counting them as in flight. Blocks while the ring is
+// full. Returns -1 if some job could not be queued.
+int queue_push_batch(Job *list);
+
+// Timer thread: put back a job that is already in flight (a job resumed
+// after msleep, see timer.h). It is not counted again.
+void queue_requeue(Job *job);
+
+// Worker: take 1 .. max jobs (out[], oldest first). Blocks while the
+// queue is empty; returns 0 once the queue is closed and drained.
+int  queue_pop_batch(int worker_id, Job **out, int max);
+
+// Worker: n jobs taken with queue_pop_batch have finished
+void queue_jobs_done(int worker_id, int n);
+
+// Dispatcher: block until no job is queued or running
+void queue_wait_all(void);
+
+// Jobs queued or running (or sleeping, msleep=timer) right now
+unsigned int queue_in_flight(void);
+
+// Dispatcher: 1 if no job is in flight right now (does not block)
+int  queue_idle(void);
+
+// Serve mode, before any job: write 1 to the eventfd fd every time the
+// in-flight count drops to zero, so an epoll loop can wait for a barrier
+void queue_set_idle_fd(int fd);
+
+// Dispatcher: no more jobs will come; wake every sleeping worker
+void queue_close(void);
+
+#endif
@@ -0,0 +1,66 @@
+// ============================================================================
+// reader.h  — Command file reader (no line length limit)
+// ============================================================================
+//
+// reader_unread gives back the last line, so the dispatcher can look one
+// line ahead (read-ahead across a barrier) and leave it for later.
+//
+// A regular file is mapped read-only in one piece; lines are returned as
+// slices of the mapping and stay valid until reader_close, so jobs can
+// point at their text instead of copying it. Anything that cannot be
+// mapped (a pipe, /dev/stdin, an empty file) is read in READER_CHUNK
+// pieces into a growing buffer; such slices are only valid until the next
+// reader_next call.
+//
+// Newlines are found with memchr, which glibc implements with SIMD.
+
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+
+#define READER_CHUNK  (1 << 20)
+
+typedef struct CmdReader {
+    int    fd;
+
+    // mmap mode
+    char  *map;
+    size_t map_size;
+    size_t pos;          // next unread byte
+
+    // stream mode: unread data is buf[start .. end)
+    char  *buf;
+    size_t cap;
+    size_t start;
+    size_t end;
+    int    eof;
+    int    error;        // a read failed; every later call returns -1
+
+    // line given back with reader_unread
+    const char *back;
+    size_t      back_len;
+    int         has_back;
+} CmdReader;
+
+// Open path; returns 0 or -1 (error already reported)
+int  reader_open(CmdReader *r, const char *path);
+
+// Next line without its '\n'. Returns 1 and sets *line/*len, 0 at end of
+// file, -1 on a read error.
+int  reader_next(CmdReader *r, const char **line, size_t *len);
+
+// Give back the line just returned by reader_next; the next call returns
+// it again. Only one line can be given back.
+void reader_unread(CmdReader *r, const char *line, size_t len);
+
+// 1 if returned lines live until reader_close (mmap mode)
+int  reader_stable(const CmdReader *r);
+
+// 1 if reader_next would return without waiting for more input: mmap
+// mode, a line given back, end of file, or a complete line buffered
+int  reader_ready(const CmdReader *r);
+
+void reader_close(CmdReader *r);
+
+#endif
@@ -0,0 +1,52 @@
+// ============================================================================
+// server.h  — Service mode: job streams over a UNIX domain socket
+// ============================================================================
+//
+// "hw2 <socket> <num_threads> <num_counters> <log_enabled> mode=serve"
+// starts the system once (workers, counters, logs) and then serves any
+// number of clients on a SOCK_STREAM UNIX socket at <socket> from one
+// epoll loop in the dispatcher thread. The worker pool, the counter store
+// and the statistics stay warm from one submission to the next.
+//
+// Clients send lines, exactly like a cmdfile, plus a few requests:
+//
+//   worker ...        queued as a job (no reply; malformed: "error ...")
+//   dispatcher_wait   barrier over every client's jobs, replies "ok N"
+//                     (N = jobs finished so far) once nothing is in flight
+//   get <cid>         replies the counter's current value (delta mode: as
+//                     of the workers' last merge)
+//   stats             replies live numbers and the stats.txt lines as of
+//                     the last idle moment, then "end"
+//   shutdown          replies "bye"; the server finishes the jobs, writes
+//                     stats.txt and exits (as does SIGINT / SIGTERM)
+//
+// While a barrier is pending, job lines from every client are held back
+// (left unread), so it completes like dispatcher_wait in a cmdfile;
+// "get"/"stats" are still answered. dispatcher_msleep is refused, it
+// would stall every client.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#define MODE_FILE   0
+#define MODE_SERVE  1
+
+#define SERVER_MAX_CLIENTS  1024
+#define SERVER_LINE_MAX     (64 * 1024)   // longest line a client may send
+#define SERVER_BACKLOG      64
+
+extern int g_run_mode;   // MODE_FILE / MODE_SERVE
+
+// Before init_system (no thread exists yet): create and bind the socket
+// at path and block SIGINT/SIGTERM in every thread; the server takes them
+// from a signalfd. Returns 0, or -1 with a message.
+int  server_init(const char *path);
+
+// Serve clients until "shutdown" or a signal. *line_id numbers the jobs
+// (logs). Jobs may still be in flight on return. Returns 0, -1 on error.
+int  server_run(unsigned int *line_id);
+
+// Close every connection and remove the socket
+void server_close(void);
+
+#endif
@@ -0,0 +1,63 @@
+// ============================================================================
+// stats.h  — Per-worker job latency histograms (merged for stats.txt)
+// ============================================================================
+//
+// Every worker records its own jobs into private histograms, so the hot
+// path takes no lock and shares no cache line. write_stats_file merges
+// them once all jobs are done. Turnaround is also kept per priority
+// class, with a count of deadlines met and missed.
+//
+// Values are nanoseconds. Histograms are log-linear: values below HIST_SUB
+// are exact, above that every power of two is split into HIST_SUB buckets
+// (error < 1/HIST_SUB, about 3%). count/sum/min/max are kept exactly.
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "func.h"   // PRIO_CLASSES
+
+#define HIST_SUB_BITS  5
+#define HIST_SUB       (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS  48      // larger values (> 3 days) go to the last bucket
+#define HIST_BUCKETS   ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+#define STAT_TURNAROUND  0     // read by dispatcher → END
+#define STAT_QUEUE_WAIT  1     // read by dispatcher → START
+#define STAT_EXEC        2     // START → END
+#define NUM_STATS        3
+
+typedef struct Histogram {
+    long long count;
+    long long sum;
+    long long min;
+    long long max;
+    long long bucket[HIST_BUCKETS];
+} Histogram;
+
+void      hist_add(Histogram *h, long long v);
+void      hist_merge(Histogram *dst, const Histogram *src);
+
+// Value at fraction p (0..1) of the distribution, 0 if empty
+long long hist_percentile(const Histogram *h, double p);
+
+// Allocate one set of histograms per worker
+int  stats_init(int num_workers);
+
+// Worker side: one finished job of priority class prio
+void stats_record(int worker_id, int prio, long long turnaround,
+                  long long queue_wait, long long exec);
+
+// Worker side: a job with a deadline finished (late or not)
+void stats_deadline(int worker_id, int missed);
+
+// Sum all workers into out[NUM_STATS]. Only valid when no job is running
+// (the in-flight count orders the workers' records before this).
+void stats_merge(Histogram out[NUM_STATS]);
+
+// Same for the per-class turnaround and the deadline counts
+void stats_merge_prio(Histogram out[PRIO_CLASSES], long long *deadline_jobs,
+                      long long *deadline_missed);
+
+void stats_destroy(void);
+
+#endif
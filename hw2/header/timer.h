@@ -0,0 +1,46 @@
+// ============================================================================
+// timer.h  — Hierarchical timer wheel for suspended jobs ("msleep=timer")
+// ============================================================================
+//
+// msleep=block (default) runs "msleep X" inside the job with usleep, so
+// the worker thread sleeps with it. With msleep=timer the worker instead
+// saves where the job stopped (see Job::pc / iter_left), hands the job to
+// the timer thread and takes the next job from the queue. When the time
+// is up the timer thread puts the job back in the queue and any worker
+// resumes it. The job stays "in flight" the whole time, so
+// dispatcher_wait still waits for it.
+//
+// The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots; a slot of level
+// L spans 64^L ticks of 1 ms. Adding a timer and expiring one are O(1); a
+// job is moved down a level at most WHEEL_LEVELS - 1 times. Wake times
+// are kept in ns (Job::wake_ns) and rounded up to a tick, so a job may
+// resume up to 1 ms late but never early.
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "func.h"
+
+#define MSLEEP_BLOCK  0
+#define MSLEEP_TIMER  1
+
+#define WHEEL_BITS    6
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)
+#define WHEEL_LEVELS  4          // 64^4 ms = 4.6 hours; longer sleeps re-cascade
+#define WHEEL_TICK_NS 1000000LL  // 1 ms
+
+extern int g_msleep_mode;   // MSLEEP_BLOCK / MSLEEP_TIMER
+
+// Start the timer thread (timer mode only)
+int  timer_init(void);
+
+// Worker: resume job in ms milliseconds (ms > 0)
+void timer_add(Job *job, int ms);
+
+// Jobs sleeping on the timer right now (in flight, but holding no worker)
+int  timer_suspended(void);
+
+// Stop the timer thread. No job may be sleeping (after the last barrier).
+void timer_shutdown(void);
+
+#endif
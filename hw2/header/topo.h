@@ -0,0 +1,51 @@
+// ============================================================================
+// topo.h  — CPU/NUMA topology, worker pinning, node-local allocation
+// ============================================================================
+//
+// "affinity=..." on the command line:
+//
+//   none     workers float, the kernel decides (default)
+//   compact  worker i runs on the i-th allowed CPU, node by node, so the
+//            first workers share a socket
+//   scatter  consecutive workers alternate between nodes
+//
+// Worker i is pinned (pthread_setaffinity_np) to order[i % num_cpus] when
+// it starts. The node of every CPU comes from libnuma when hw2 is built
+// with HAVE_LIBNUMA (make HAVE_LIBNUMA=1), otherwise from sysfs.
+//
+// Node-local memory: with libnuma, topo_alloc_on_node binds the pages to
+// the node. Without it the pages are fresh zero pages from mmap and land
+// on the node of the thread that touches them first, so the owner (a
+// pinned worker) must be the first to write them.
+
+#ifndef TOPO_H
+#define TOPO_H
+
+#include <stddef.h>
+
+#define AFFINITY_NONE     0
+#define AFFINITY_COMPACT  1
+#define AFFINITY_SCATTER  2
+
+extern int g_affinity_mode;   // AFFINITY_NONE / _COMPACT / _SCATTER
+
+// Discover CPUs and nodes and choose the CPU order. With affinity on,
+// prints the topology and the order. Returns 0 or -1.
+int  topo_init(void);
+
+// Worker thread: pin itself to its CPU (no-op with affinity=none)
+void topo_pin_worker(int worker_id);
+
+// Node worker_id runs on, or -1 if workers are not pinned
+int  topo_worker_node(int worker_id);
+
+// Zeroed, page aligned memory. node < 0: no preference. Free with topo_free.
+void *topo_alloc_on_node(size_t size, int node);
+
+// Bind [p, p + size) (page aligned) to node; no-op without libnuma or
+// with node < 0
+void topo_bind(void *p, size_t size, int node);
+
+void topo_free(void *p, size_t size);
+
+#endif
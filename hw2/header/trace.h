@@ -0,0 +1,52 @@
+// ============================================================================
+// trace.h  — trace.bin format ("log=binary"), read by tools/trace_decode
+// ============================================================================
+//
+// File = TraceFileHeader, then frames. A frame is a TraceFrame followed by
+// len bytes of one sink's stream (sink 0 .. num_workers-1 = worker,
+// sink num_workers = dispatcher). Concatenating a sink's frames gives its
+// stream back; records may be split across frames.
+//
+// A stream is a sequence of TraceRecords (16 bytes). Two of them carry a
+// payload right after the record:
+//
+//   TRACE_STRING  new string table entry, id = job_id field;
+//                 payload: unsigned int len, then len bytes of text
+//   TRACE_READ    the dispatcher read a line;
+//                 payload: unsigned int string id of the line
+//
+// TRACE_START / TRACE_END refer to the line by job_id only, so a job's
+// text is stored once (and identical lines share one string).
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_FILE        "trace.bin"
+#define TRACE_MAGIC       "HW2TRACE"
+#define TRACE_VERSION     1
+#define TRACE_DISPATCHER  0xFFFF   // worker field of dispatcher records
+
+#define TRACE_READ    0    // same values as LOG_READ / LOG_START / LOG_END
+#define TRACE_START   1
+#define TRACE_END     2
+#define TRACE_STRING  3
+
+typedef struct TraceFileHeader {
+    char         magic[8];       // TRACE_MAGIC, no NUL
+    unsigned int version;
+    unsigned int num_workers;
+} TraceFileHeader;
+
+typedef struct TraceFrame {
+    unsigned int sink;
+    unsigned int len;            // bytes of stream data that follow
+} TraceFrame;
+
+typedef struct TraceRecord {
+    long long      time_ns;      // since program start
+    unsigned int   job_id;       // line number of the job (string id for TRACE_STRING)
+    unsigned short event;        // TRACE_*
+    unsigned short worker;       // worker id, or TRACE_DISPATCHER
+} TraceRecord;
+
+#endif
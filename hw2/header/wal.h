@@ -0,0 +1,100 @@
+// ============================================================================
+// wal.h  — Write-ahead log with group commit ("durable=on")
+// ============================================================================
+//
+// Without it counters.bin is just memory: a crash loses every count. With
+// durable=on every counter delta is also written to counters.wal, and a
+// job counts as done (in flight for dispatcher_wait, "ok" in serve mode)
+// until its deltas are on disk.
+//
+// Workers collect the deltas of the jobs they run in a private table.
+// After each batch (queue.h batch=N) the table becomes one WAL record:
+//
+//   WalRecord header (magic, entry count, sequence number, crc32)
+//   count x WalEntry (counter id, delta)
+//
+// It is copied into a shared buffer and the worker waits. The committer
+// thread writes the buffer with one write() and one fdatasync(), then
+// wakes every worker whose record it held: a group commit. It commits
+// once commit_us microseconds have passed since the first record came
+// in, or sooner when records for commit_jobs jobs are waiting (default:
+// a full batch from every worker) or every started worker is waiting.
+// commit_us=0 commits as soon as the previous fdatasync returns.
+//
+// Snapshots: at a barrier (no job in flight, every record on disk) that
+// finds more than snapshot_mb MB in the WAL, and at shutdown, the counter
+// values go to counters.snap (written to a temporary file, synced and
+// renamed over the old one) together with the last sequence number they
+// include; then the WAL is emptied.
+//
+// Recovery (init_system → counter_store_init): load counters.snap, replay
+// the WAL records after its sequence number and cut the WAL at the first
+// torn or corrupt record. What is lost in a crash is the jobs whose
+// records had not been committed yet, and they were never reported done.
+// A failed write or fdatasync of the WAL is treated the same way: hw2
+// stops at once (exit status 1) instead of reporting those jobs done.
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdio.h>
+
+#define WAL_FILE        "counters.wal"
+#define SNAPSHOT_FILE   "counters.snap"
+#define WAL_MAGIC       0x314c4157u     // "WAL1" little-endian
+#define SNAPSHOT_MAGIC  "HW2SNAP1"
+
+// counters.wal: records, back to back
+typedef struct WalRecord {
+    unsigned int       magic;      // WAL_MAGIC
+    unsigned int       count;      // WalEntry that follow
+    unsigned long long seq;        // 1, 2, 3, ... (not reset by snapshots)
+    unsigned int       crc;        // crc32 of the entries, then count and seq
+    unsigned int       unused;
+} WalRecord;
+
+typedef struct WalEntry {
+    int       cid;
+    int       unused;
+    long long delta;
+} WalEntry;
+
+// counters.snap: the header, then num_counters native long longs
+typedef struct SnapshotHeader {
+    char               magic[8];   // SNAPSHOT_MAGIC, no NUL
+    unsigned long long seq;        // last WAL record included
+    int                num_counters;
+    unsigned int       crc;        // crc32 of the values
+} SnapshotHeader;
+
+#define COMMIT_US_DEFAULT    1000
+#define SNAPSHOT_MB_DEFAULT  16
+
+extern int g_durable;       // "durable=on|off"
+extern int g_commit_us;     // group commit window
+extern int g_commit_jobs;   // commit early at this many jobs (0: default)
+extern int g_snapshot_mb;   // snapshot once the WAL is this big
+
+// Recover the counters into values[0 .. num_counters) (all zero on
+// entry), then open the WAL and start the committer. No-op unless
+// durable. Returns 0, or -1 with a message (e.g. a counter out of range).
+int  wal_init(long long *values, int num_counters, int num_workers);
+
+// Worker: counter cid got delta (called by counter_add)
+void wal_add(int worker_id, int cid, long long delta);
+
+// Worker, after a batch that finished `jobs` jobs: log its deltas and
+// wait until they are on disk
+void wal_commit(int worker_id, int jobs);
+
+// No job in flight: snapshot if the WAL has grown past snapshot_mb (or
+// always, if force). values must be up to date.
+int  wal_checkpoint(const long long *values, int num_counters, int force);
+
+// Stop the committer and write a final snapshot (values up to date)
+void wal_close(const long long *values, int num_counters);
+
+// The "wal ..." lines of stats.txt (durable only)
+void wal_write_stats(FILE *f);
+
+#endif
@@ -0,0 +1,296 @@
+// ============================================================================
+// arena.c  — Job slab pool + line/op bump arena
+// ============================================================================
+//
+// The dispatcher is the only thread that allocates, so the allocation
+// side needs no locks at all. Workers give memory back by pushing onto
+// two lock-free "returned" stacks; the dispatcher takes each stack as a
+// whole with one atomic exchange (so there is no ABA problem) when it
+// runs out of free nodes or chunks.
+
+#include <stdatomic.h>
+#include "../header/func.h"
+#include "../header/arena.h"
+
+int g_alloc_mode = ALLOC_ARENA;
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;      // free / returned list link
+    _Atomic int refs;             // jobs using this chunk (+1 while current)
+    size_t size;                  // usable bytes in data[]
+    size_t used;                  // bump offset (dispatcher only)
+    _Alignas(16) char data[];
+} ArenaChunk;
+
+typedef struct JobSlab {
+    struct JobSlab *next;
+    Job jobs[JOB_SLAB_SIZE];
+} JobSlab;
+
+// Dispatcher-only state
+static ArenaChunk *s_current     = NULL;
+static ArenaChunk *s_free_chunks = NULL;
+static Job        *s_free_jobs   = NULL;
+static JobSlab    *s_slabs       = NULL;
+
+// Filled by workers
+static _Atomic(ArenaChunk *) s_returned_chunks = NULL;
+static _Atomic(Job *)        s_returned_jobs   = NULL;
+
+
+static size_t align16(size_t n)
+{
+    return (n + 15) & ~(size_t)15;
+}
+
+
+// ============================================================================
+// JOB SLAB POOL
+// ============================================================================
+
+static Job *pool_get(void)
+{
+    if (!s_free_jobs)
+        s_free_jobs = atomic_exchange(&s_returned_jobs, NULL);
+
+    if (!s_free_jobs) {
+        JobSlab *slab = malloc(sizeof(JobSlab));
+        if (!slab) {
+            report_syscall_error("malloc");
+            return NULL;
+        }
+        slab->next = s_slabs;
+        s_slabs = slab;
+
+        for (int i = 0; i < JOB_SLAB_SIZE; i++) {
+            slab->jobs[i].next = s_free_jobs;
+            s_free_jobs = &slab->jobs[i];
+        }
+    }
+
+    Job *job = s_free_jobs;
+    s_free_jobs = job->next;
+    return job;
+}
+
+static void pool_put(Job *job)
+{
+    Job *head = atomic_load(&s_returned_jobs);
+    do {
+        job->next = head;
+    } while (!atomic_compare_exchange_weak(&s_returned_jobs, &head, job));
+}
+
+
+// ============================================================================
+// CHUNK ARENA
+// ============================================================================
+
+// Drop one reference; the last one hands the chunk back to the dispatcher
+static void chunk_release(ArenaChunk *c)
+{
+    if (atomic_fetch_sub(&c->refs, 1) != 1)
+        return;
+
+    ArenaChunk *head = atomic_load(&s_returned_chunks);
+    do {
+        c->next = head;
+    } while (!atomic_compare_exchange_weak(&s_returned_chunks, &head, c));
+}
+
+// Move returned chunks to the free list (oversized ones are freed)
+static void collect_returned_chunks(void)
+{
+    ArenaChunk *c = atomic_exchange(&s_returned_chunks, NULL);
+    while (c) {
+        ArenaChunk *next = c->next;
+        if (c->size == ARENA_CHUNK_SIZE) {
+            c->next = s_free_chunks;
+            s_free_chunks = c;
+        } else {
+            free(c);
+        }
+        c = next;
+    }
+}
+
+static ArenaChunk *chunk_new(size_t size)
+{
+    ArenaChunk *c;
+
+    if (size == ARENA_CHUNK_SIZE) {
+        if (!s_free_chunks)
+            collect_returned_chunks();
+        if (s_free_chunks) {
+            c = s_free_chunks;
+            s_free_chunks = c->next;
+            c->used = 0;
+            return c;
+        }
+    }
+
+    c = malloc(sizeof(ArenaChunk) + size);
+    if (!c) {
+        report_syscall_error("malloc");
+        return NULL;
+    }
+    c->next = NULL;
+    atomic_init(&c->refs, 0);
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+// Bump-allocate n bytes; *chunk_out gets the chunk to reference
+static void *arena_alloc(size_t n, ArenaChunk **chunk_out)
+{
+    n = align16(n);
+
+    // Big requests get a chunk of their own
+    if (n > ARENA_CHUNK_SIZE / 4) {
+        ArenaChunk *c = chunk_new(n);
+        if (!c)
+            return NULL;
+        c->used = n;
+        *chunk_out = c;
+        return c->data;
+    }
+
+    if (!s_current || s_current->used + n > s_current->size) {
+        ArenaChunk *c = chunk_new(ARENA_CHUNK_SIZE);
+        if (!c)
+            return NULL;
+        atomic_store(&c->refs, 1);   // the "current chunk" reference
+
+        if (s_current)
+            chunk_release(s_current);
+        s_current = c;
+    }
+
+    void *p = s_current->data + s_current->used;
+    s_current->used += n;
+    *chunk_out = s_current;
+    return p;
+}
+
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+Job *job_alloc(const char *line, size_t len, int copy_line,
+               const Op *ops, int num_ops)
+{
+    size_t ops_size = sizeof(Op) * (size_t)num_ops;
+
+    if (g_alloc_mode == ALLOC_MALLOC) {
+        Job *job = malloc(sizeof(Job));
+        char *text = malloc(len + 1);
+        Op *o = malloc(ops_size ? ops_size : 1);
+        if (!job || !text || !o) {
+            report_syscall_error("malloc");
+            free(job);
+            free(text);
+            free(o);
+            return NULL;
+        }
+        memcpy(text, line, len);
+        text[len] = '\0';
+        memcpy(o, ops, ops_size);
+
+        job->line     = text;
+        job->line_len = len;
+        job->ops      = o;
+        job->num_ops  = num_ops;
+        job->chunk    = NULL;
+        return job;
+    }
+
+    Job *job = pool_get();
+    if (!job)
+        return NULL;
+
+    // Ops first (they need 8-byte alignment), then the text if copied
+    size_t text_size = copy_line ? len + 1 : 0;
+    ArenaChunk *c;
+    char *mem = arena_alloc(align16(ops_size) + text_size, &c);
+    if (!mem) {
+        pool_put(job);
+        return NULL;
+    }
+    atomic_fetch_add(&c->refs, 1);
+
+    Op *o = (Op *)mem;
+    memcpy(o, ops, ops_size);
+
+    if (copy_line) {
+        char *text = mem + align16(ops_size);
+        memcpy(text, line, len);
+        text[len] = '\0';
+        line = text;
+    }
+
+    job->line     = line;
+    job->line_len = len;
+    job->ops     = o;
+    job->num_ops = num_ops;
+    job->chunk   = c;
+    return job;
+}
+
+void job_free(Job *job)
+{
+    if (!job->chunk) {
+        free(job->ops);
+        free((void *)job->line);
+        free(job);
+        return;
+    }
+
+    chunk_release(job->chunk);
+    pool_put(job);
+}
+
+void arena_reset(void)
+{
+    if (g_alloc_mode != ALLOC_ARENA)
+        return;
+
+    // No job is in flight: every old chunk is back, and the current one
+    // is only held by its "current" reference, so it can be rewound.
+    collect_returned_chunks();
+    if (s_current && atomic_load(&s_current->refs) == 1)
+        s_current->used = 0;
+
+    // Same for job nodes
+    Job *list = atomic_exchange(&s_returned_jobs, NULL);
+    while (list) {
+        Job *next = list->next;
+        list->next = s_free_jobs;
+        s_free_jobs = list;
+        list = next;
+    }
+}
+
+void arena_destroy(void)
+{
+    if (s_current) {
+        chunk_release(s_current);
+        s_current = NULL;
+    }
+    collect_returned_chunks();
+
+    while (s_free_chunks) {
+        ArenaChunk *next = s_free_chunks->next;
+        free(s_free_chunks);
+        s_free_chunks = next;
+    }
+
+    while (s_slabs) {
+        JobSlab *next = s_slabs->next;
+        free(s_slabs);
+        s_slabs = next;
+    }
+    s_free_jobs = NULL;
+    atomic_store(&s_returned_jobs, NULL);
+}
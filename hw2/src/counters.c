@@ -0,0 +1,365 @@
+// ============================================================================
+// counters.c  — Counter store (memory-mapped counters.bin + text export)
+// ============================================================================
+//
+// All counters live in memory: in lock mode and with many counters
+// directly in the records mapped from counters.bin, otherwise in an array
+// of padded atomics that is copied into the mapping on every sync. An
+// increment never touches a file; the text files are refreshed only at
+// barriers/shutdown, and only when they are exported.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../header/func.h"
+#include "../header/counters.h"
+#include "../header/topo.h"
+#include "../header/metrics.h"
+#include "../header/wal.h"
+
+int g_counter_mode = COUNTERS_ATOMIC;
+int g_export_mode  = EXPORT_AUTO;
+
+// One counter per cache line (atomic and delta modes, few counters)
+typedef struct PaddedCounter {
+    _Alignas(CACHE_LINE) _Atomic long long value;
+} PaddedCounter;
+
+static PaddedCounter *s_atomic = NULL;   // NULL: atomics on the mapping
+
+// Private per-worker table (delta mode): open addressing on the counter
+// id, so its size does not depend on the number of counters. Only its
+// owner adds to it; merging (owner when full or idle, dispatcher at a
+// sync) holds the lock.
+#define DELTA_BITS      9
+#define DELTA_SLOTS     (1 << DELTA_BITS)
+#define DELTA_FLUSH_AT  (DELTA_SLOTS * 3 / 4)   // keep probes short
+
+typedef struct DeltaSlot {
+    int       key;           // cid + 1, 0 = empty
+    long long delta;
+} DeltaSlot;
+
+typedef struct WorkerDeltas {
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
+    DeltaSlot *slot;         // DELTA_SLOTS entries
+    int       *dirty;        // slots in use since the last merge
+    int        num_dirty;
+} WorkerDeltas;
+
+static WorkerDeltas  *s_workers     = NULL;
+static int            s_num_workers = 0;
+static char          *s_delta_rows  = NULL;   // backing storage of the buffers
+static size_t         s_rows_size   = 0;
+
+static int        s_fd           = -1;
+static long long *s_values       = NULL;  // mapped counters.bin
+static long long *s_last_written = NULL;  // value last written to countNN.txt
+static int        s_export_text  = 0;
+static size_t     s_map_size     = 0;
+static int        s_num_counters = 0;
+
+
+// Write one counter to its text file
+static int write_counter_file(int cid, long long val)
+{
+    char fname[32];
+    sprintf(fname, "count%02d.txt", cid);
+
+    FILE *f = fopen(fname, "w");
+    if (!f) {
+        report_syscall_error("fopen");
+        return -1;
+    }
+    fprintf(f, "%lld\n", val);
+    fclose(f);
+    return 0;
+}
+
+
+// ============================================================================
+// INIT
+// ============================================================================
+
+static int init_worker_deltas(int num_workers)
+{
+    // One block; worker w owns row w = slot[] + dirty[].
+    // Rows are rounded up to whole cache lines so no two workers share a
+    // line, or to whole pages when workers are pinned so each row can
+    // live on its worker's NUMA node.
+    size_t align = (topo_worker_node(0) >= 0) ? (size_t)sysconf(_SC_PAGESIZE)
+                                              : CACHE_LINE;
+    size_t row   = DELTA_SLOTS * (sizeof(DeltaSlot) + sizeof(int));
+    row = (row + align - 1) / align * align;
+    size_t n     = (size_t)num_workers;
+
+    s_workers = aligned_alloc(CACHE_LINE, sizeof(WorkerDeltas) * n);
+    if (!s_workers) {
+        report_syscall_error("aligned_alloc");
+        return -1;
+    }
+
+    // Zero pages that nobody has touched yet: without libnuma a row is
+    // placed where its worker first writes it
+    s_rows_size  = row * n;
+    s_delta_rows = topo_alloc_on_node(s_rows_size, -1);
+    if (!s_delta_rows)
+        return -1;
+
+    s_num_workers = num_workers;
+    for (int w = 0; w < num_workers; w++) {
+        WorkerDeltas *wd = &s_workers[w];
+        char *r = s_delta_rows + row * (size_t)w;
+        topo_bind(r, row, topo_worker_node(w));
+
+        pthread_mutex_init(&wd->lock, NULL);
+        wd->slot      = (DeltaSlot *)r;
+        wd->dirty     = (int *)(r + DELTA_SLOTS * sizeof(DeltaSlot));
+        wd->num_dirty = 0;
+    }
+    return 0;
+}
+
+int counter_store_init(int num_counters, int num_workers)
+{
+    s_num_counters = num_counters;
+    s_map_size     = sizeof(long long) * (size_t)num_counters;
+
+    // Create (or truncate) the backing file and size it. ftruncate fills
+    // the file with zeros (a hole, no block is written), so every counter
+    // starts at 0 whatever their number.
+    s_fd = open(COUNTER_STORE_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (s_fd < 0) {
+        report_syscall_error("open");
+        return -1;
+    }
+    if (ftruncate(s_fd, (off_t)s_map_size) != 0) {
+        report_syscall_error("ftruncate");
+        close(s_fd);
+        s_fd = -1;
+        return -1;
+    }
+
+    void *p = mmap(NULL, s_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, s_fd, 0);
+    if (p == MAP_FAILED) {
+        report_syscall_error("mmap");
+        close(s_fd);
+        s_fd = -1;
+        return -1;
+    }
+    s_values = p;
+
+    // durable=on: the values of the last run, from counters.snap + WAL
+    if (wal_init(s_values, num_counters, num_workers) != 0)
+        return -1;
+
+    if (g_counter_mode != COUNTERS_LOCK && num_counters <= COUNTER_PAD_MAX) {
+        s_atomic = aligned_alloc(CACHE_LINE,
+                                 sizeof(PaddedCounter) * (size_t)num_counters);
+        if (!s_atomic) {
+            report_syscall_error("aligned_alloc");
+            return -1;
+        }
+        for (int i = 0; i < num_counters; i++)
+            atomic_init(&s_atomic[i].value, s_values[i]);
+    }
+
+    if (g_counter_mode == COUNTERS_DELTA && init_worker_deltas(num_workers) != 0)
+        return -1;
+
+    // Legacy text files: asked for, or few enough to be what is expected
+    s_export_text = (g_export_mode == EXPORT_TEXT) ||
+                    (g_export_mode == EXPORT_AUTO && num_counters <= EXPORT_TEXT_MAX);
+    if (!s_export_text)
+        return 0;
+
+    s_last_written = calloc((size_t)num_counters, sizeof(long long));
+    if (!s_last_written) {
+        report_syscall_error("calloc");
+        return -1;
+    }
+
+    // Create the text files with "0" like before (or the recovered value)
+    for (int i = 0; i < num_counters; i++) {
+        if (write_counter_file(i, s_values[i]) != 0)
+            return -1;
+        s_last_written[i] = s_values[i];
+    }
+
+    return 0;
+}
+
+
+// ============================================================================
+// HOT PATH
+// ============================================================================
+
+// The atomic of counter cid (atomic and delta modes)
+static _Atomic long long *cell(int cid)
+{
+    if (s_atomic)
+        return &s_atomic[cid].value;
+
+    // A long long record of the mapping, updated in place
+    return (_Atomic long long *)&s_values[cid];
+}
+
+static void store_add(int worker_id, int cid, long long delta)
+{
+    if (g_counter_mode == COUNTERS_LOCK) {
+        pthread_mutex_t *m = &g_counter_mutex[COUNTER_STRIPE(cid)].mutex;
+        METRICS_LOCK(m, worker_id, cid);
+        s_values[cid] += delta;
+        pthread_mutex_unlock(m);
+    } else {
+        atomic_fetch_add_explicit(cell(cid), delta, memory_order_relaxed);
+    }
+}
+
+// The slot of cid in a delta table, claimed if cid is not there yet
+static DeltaSlot *delta_slot(WorkerDeltas *wd, int cid)
+{
+    unsigned int h = ((unsigned int)cid * 2654435761u) >> (32 - DELTA_BITS);
+    for (;;) {
+        DeltaSlot *s = &wd->slot[h];
+        if (s->key == cid + 1)
+            return s;
+        if (s->key == 0) {
+            s->key = cid + 1;
+            wd->dirty[wd->num_dirty++] = (int)h;
+            return s;
+        }
+        h = (h + 1) & (DELTA_SLOTS - 1);
+    }
+}
+
+void counter_add(int worker_id, int cid, long long delta)
+{
+    if (g_durable)
+        wal_add(worker_id, cid, delta);
+
+    if (g_counter_mode != COUNTERS_DELTA) {
+        store_add(worker_id, cid, delta);
+        return;
+    }
+
+    // Delta mode: no lock, no shared cache line, until the table fills
+    WorkerDeltas *wd = &s_workers[worker_id];
+    if (wd->num_dirty >= DELTA_FLUSH_AT)
+        counter_flush_worker(worker_id);
+    delta_slot(wd, cid)->delta += delta;
+}
+
+long long counter_get(int cid)
+{
+    if (g_counter_mode != COUNTERS_LOCK)
+        return atomic_load_explicit(cell(cid), memory_order_relaxed);
+
+    pthread_mutex_t *m = &g_counter_mutex[COUNTER_STRIPE(cid)].mutex;
+    pthread_mutex_lock(m);
+    long long val = s_values[cid];
+    pthread_mutex_unlock(m);
+    return val;
+}
+
+
+// ============================================================================
+// DELTA MERGING
+// ============================================================================
+
+void counter_flush_worker(int worker_id)
+{
+    if (g_counter_mode != COUNTERS_DELTA || !s_workers)
+        return;
+
+    WorkerDeltas *wd = &s_workers[worker_id];
+    pthread_mutex_lock(&wd->lock);
+    for (int i = 0; i < wd->num_dirty; i++) {
+        DeltaSlot *s = &wd->slot[wd->dirty[i]];
+        if (s->delta != 0)
+            store_add(worker_id, s->key - 1, s->delta);
+        s->key   = 0;
+        s->delta = 0;
+    }
+    wd->num_dirty = 0;
+    pthread_mutex_unlock(&wd->lock);
+}
+
+
+// ============================================================================
+// SYNC TO counters.bin / countNN.txt
+// ============================================================================
+
+int counter_store_sync(void)
+{
+    if (!s_values)
+        return 0;
+
+    for (int w = 0; w < s_num_workers; w++)
+        counter_flush_worker(w);
+
+    // Snapshot the padded atomics into counters.bin (every other mode
+    // updates it in place)
+    if (s_atomic) {
+        for (int i = 0; i < s_num_counters; i++)
+            s_values[i] = atomic_load_explicit(&s_atomic[i].value,
+                                               memory_order_relaxed);
+    }
+
+    // durable=on: a snapshot once the WAL has grown big enough
+    int rc = wal_checkpoint(s_values, s_num_counters, 0);
+
+    if (!s_export_text)
+        return rc;
+
+    for (int i = 0; i < s_num_counters; i++) {
+        long long val = counter_get(i);
+
+        // Unchanged counters keep their file as is
+        if (val == s_last_written[i])
+            continue;
+
+        METRICS_START(t_io);
+        if (write_counter_file(i, val) != 0)
+            rc = -1;
+        else
+            s_last_written[i] = val;
+        METRICS_STOP(MET_DISPATCHER, MET_FILE_IO, t_io);
+    }
+    return rc;
+}
+
+
+// ============================================================================
+// CLOSE
+// ============================================================================
+
+void counter_store_close(void)
+{
+    // Final snapshot, from the values counter_store_sync left
+    if (s_values)
+        wal_close(s_values, s_num_counters);
+
+    if (s_values) {
+        munmap(s_values, s_map_size);
+        s_values = NULL;
+    }
+    if (s_fd >= 0) {
+        close(s_fd);
+        s_fd = -1;
+    }
+    free(s_last_written);
+    s_last_written = NULL;
+    s_export_text  = 0;
+    free(s_atomic);
+    s_atomic = NULL;
+
+    for (int w = 0; w < s_num_workers; w++)
+        pthread_mutex_destroy(&s_workers[w].lock);
+    free(s_workers);
+    topo_free(s_delta_rows, s_rows_size);
+    s_workers     = NULL;
+    s_delta_rows  = NULL;
+    s_rows_size   = 0;
+    s_num_workers = 0;
+}
@@ -5,49 +5,67 @@
 
 #include <ctype.h>      // for isspace()
 #include "../header/func.h"
+#include "../header/counters.h"
+#include "../header/parse.h"
+#include "../header/queue.h"
+#include "../header/arena.h"
+#include "../header/logger.h"
+#include "../header/stats.h"
+#include "../header/timer.h"
+#include "../header/pool.h"
+#include "../header/topo.h"
+#include "../header/metrics.h"
+#include "../header/wal.h"
 
 // -------------------------
 // Global variables
 // -------------------------
 
-JobQueue g_job_queue;
 Stats    g_stats;
-extern pthread_mutex_t g_counter_mutex[MAX_COUNTERS];
 
 
-long long g_start_time_ms = 0;
-
-int g_jobs_in_progress = 0;
-pthread_mutex_t g_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t  g_jobs_zero_cond = PTHREAD_COND_INITIALIZER;
+long long g_start_time_ns = 0;
 
 int g_dispatcher_done = 0;
 int g_log_enabled     = 0;
 int g_num_counters    = 0;
 int g_num_threads     = 0;
 
-pthread_t *g_worker_threads = NULL; // allocated in init_system
-
 
 // ============================================================================
 // TIME HELPERS
 // ============================================================================
 
-// Return current time in ms since system boot (monotonic clock)
-long long now_ms(void)
+// Return current time in ns since system boot (monotonic clock).
+// clock_gettime(CLOCK_MONOTONIC) is served by the vDSO: no syscall, a few
+// tens of ns, and unlike a raw TSC read it needs no calibration.
+long long now_ns(void)
 {
     struct timespec ts;
     if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
         report_syscall_error("clock_gettime");
         return 0;
     }
-    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-// Return ms since program started
+// Return current time in ms (same clock)
+long long now_ms(void)
+{
+    return now_ns() / 1000000;
+}
+
+// Return ns since program started
+long long since_start_ns(void)
+{
+    return now_ns() - g_start_time_ns;
+}
+
+// Return ms since program started (derived from the ns value, so log
+// timestamps and trace timestamps always agree)
 long long since_start_ms(void)
 {
-    return now_ms() - g_start_time_ms;
+    return since_start_ns() / 1000000;
 }
 
 // Sleep without busy-waiting
@@ -66,100 +84,70 @@ void report_syscall_error(const char *name)
 
 
 // ============================================================================
-// EXECUTE A SINGLE BASIC COMMAND (worker side)
-// This function handles: msleep, increment, decrement.
-// The repeat logic is handled in worker_thread_main.
+// RUN DECODED OPS (worker side)
+// The ops were parsed once by the dispatcher (see parse.c), so this is a
+// plain interpreter loop with no string handling.
+//
+// The job remembers where it is (pc, iter_left), so with msleep=timer it
+// can stop at an msleep and be resumed later, maybe by another worker.
 // ============================================================================
 
-static void execute_single_command(char *cmd)
+// Run ops[job->pc .. to). Returns 0 when `to` is reached, or the ms of an
+// msleep that suspends the job (msleep=timer; pc is then past it).
+static int run_ops(int worker_id, Job *job, int to)
 {
-    // Remove spaces before the command
-    while (*cmd && isspace((unsigned char)*cmd)) cmd++;
-
-    // ---------------------
-    // msleep X
-    // ---------------------
-    if (strncmp(cmd, "msleep", 6) == 0 &&
-        (cmd[6] == '\0' || isspace((unsigned char)cmd[6])))
-    {
-        char *p = cmd + 6;
-        while (*p && isspace((unsigned char)*p)) p++;
-        msleep_ms(atoi(p));
-        return;
-    }
-
-    // ---------------------
-    // increment X
-    // ---------------------
-    if (strncmp(cmd, "increment", 9) == 0 &&
-        (cmd[9] == '\0' || isspace((unsigned char)cmd[9])))
-    {
-        char *p = cmd + 9;
-        while (*p && isspace((unsigned char)*p)) p++;
-        int cid = atoi(p);
-
-        if (cid >= 0 && cid < g_num_counters) {
-            pthread_mutex_lock(&g_counter_mutex[cid]);
-
-            char fname[32];
-            sprintf(fname, "count%02d.txt", cid);
-
-            FILE *f = fopen(fname, "r+");
-            if (!f) {
-                report_syscall_error("fopen");
-            } else {
-                long long val = 0;
-                fscanf(f, "%lld", &val);
-                val++;
-                fseek(f, 0, SEEK_SET);
-                fprintf(f, "%lld\n", val);
-                fflush(f);
-                fclose(f);
+    const Op *ops = job->ops;
+    int pc = job->pc;
+
+    while (pc < to) {
+        const Op *op = &ops[pc++];
+        switch (op->code) {
+        case OP_MSLEEP:
+            if (g_msleep_mode == MSLEEP_TIMER && op->arg > 0) {
+                job->pc = pc;
+                return op->arg;
             }
-
-            pthread_mutex_unlock(&g_counter_mutex[cid]);
+            msleep_ms(op->arg);
+            break;
+        case OP_ADD:
+            counter_add(worker_id, op->arg, op->delta);
+            break;
         }
-        return;
     }
+    job->pc = pc;
+    return 0;
+}
 
-    // ---------------------
-    // decrement X
-    // ---------------------
-    if (strncmp(cmd, "decrement", 9) == 0 &&
-        (cmd[9] == '\0' || isspace((unsigned char)cmd[9])))
-    {
-        char *p = cmd + 9;
-        while (*p && isspace((unsigned char)*p)) p++;
-        int cid = atoi(p);
-
-        if (cid >= 0 && cid < g_num_counters) {
-            pthread_mutex_lock(&g_counter_mutex[cid]);
-
-            char fname[32];
-            sprintf(fname, "count%02d.txt", cid);
-
-            FILE *f = fopen(fname, "r+");
-            if (!f) {
-                report_syscall_error("fopen");
-            } else {
-                long long val = 0;
-                fscanf(f, "%lld", &val);
-                val--;
-                fseek(f, 0, SEEK_SET);
-                fprintf(f, "%lld\n", val);
-                fflush(f);
-                fclose(f);
-            }
+// Run the job from where it stopped. Returns 0 when it has finished, or
+// the ms it must sleep before it can go on.
+static int run_job(int worker_id, Job *job)
+{
+    int ms;
 
-            pthread_mutex_unlock(&g_counter_mutex[cid]);
-        }
-        return;
+    // Commands before repeat → once
+    if (job->pc < job->repeat_start) {
+        ms = run_ops(worker_id, job, job->repeat_start);
+        if (ms)
+            return ms;
     }
 
-    // repeat is handled at a higher level, so ignore it here
+    // Commands after repeat → iter_left more times
+    while (job->iter_left > 0) {
+        ms = run_ops(worker_id, job, job->num_ops);
+        if (job->pc == job->num_ops) {
+            job->iter_left--;
+            job->pc = job->repeat_start;
+        }
+        if (ms)
+            return ms;
+    }
+    return 0;
+}
 
-    // Unknown command → print warning
-    fprintf(stderr, "hw2: invalid worker command: %s\n", cmd);
+// Called by the queue right before worker_id goes to sleep
+void worker_going_idle(int worker_id)
+{
+    counter_flush_worker(worker_id);
 }
 
 
@@ -168,173 +156,90 @@ static void execute_single_command(char *cmd)
 // WORKER THREAD FUNCTION
 // ============================================================================
 
+// Run one dequeued job until it ends or suspends. Returns 1 if it ended
+// (and was freed), 0 if it waits on the timer.
+static int run_one_job(int thread_id, Job *job)
+{
+    // -----------------------------
+    // Log job START (a resumed job already did)
+    // -----------------------------
+    if (!job->started) {
+        job->started  = 1;
+        job->start_ns = since_start_ns();
+        if (g_log_enabled)
+            log_worker(thread_id, LOG_START, job->start_ns, job->id,
+                       job->line, job->line_len);
+    }
+
+    // -----------------------------
+    // EXECUTE COMMANDS
+    // -----------------------------
+    METRICS_START(t_exec);
+    int sleep_ms = run_job(thread_id, job);
+    METRICS_STOP(thread_id, MET_EXEC, t_exec);
+    if (sleep_ms > 0) {
+        // Suspended at an msleep: the timer thread requeues it
+        timer_add(job, sleep_ms);
+        return 0;
+    }
+
+    // -----------------------------
+    // Log END
+    // -----------------------------
+    long long end_ns = since_start_ns();
+    if (g_log_enabled)
+        log_worker(thread_id, LOG_END, end_ns, job->id,
+                   job->line, job->line_len);
+
+    // -----------------------------
+    // Update statistics (this worker's histograms, no lock, in ns)
+    // -----------------------------
+    stats_record(thread_id, job->prio,
+                 end_ns - job->read_time_ns,         // turnaround
+                 job->start_ns - job->read_time_ns,  // queue wait
+                 end_ns - job->start_ns);            // execution
+    if (job->due_ns != NO_DEADLINE)
+        stats_deadline(thread_id, end_ns > job->due_ns);
+
+    job_free(job);
+    return 1;
+}
+
 static void *worker_thread_main(void *arg)
 {
     int thread_id = (int)(long)arg;
+    Job *batch[QUEUE_BATCH_MAX];
 
-    // Open log file if needed
-    FILE *logf = NULL;
-    if (g_log_enabled) {
-        char fname[32];
-        sprintf(fname, "thread%02d.txt", thread_id);
-        logf = fopen(fname, "w");
-        if (!logf) {
-            report_syscall_error("fopen");
-        }
-    }
+    // affinity=compact|scatter: stay on our CPU (and NUMA node)
+    topo_pin_worker(thread_id);
 
     while (1) {
 
         // -----------------------------
-        // DEQUEUE A JOB
+        // DEQUEUE UP TO g_queue_batch JOBS
         // -----------------------------
-        pthread_mutex_lock(&g_job_queue.mutex);
-
-        // Wait if queue is empty and more jobs may come
-        while (g_job_queue.head == NULL && g_dispatcher_done == 0) {
-            pthread_cond_wait(&g_job_queue.has_jobs, &g_job_queue.mutex);
-        }
+        METRICS_START(t_pop);
+        int n = queue_pop_batch(thread_id, batch, g_queue_batch);
+        METRICS_STOP(thread_id, MET_QUEUE_WAIT, t_pop);
 
         // No jobs AND dispatcher is done → exit thread
-        if (g_job_queue.head == NULL && g_dispatcher_done == 1) {
-            pthread_mutex_unlock(&g_job_queue.mutex);
+        if (n == 0)
             break;
-        }
-
-        // Remove job from queue
-        Job *job = g_job_queue.head;
-        g_job_queue.head = job->next;
-        if (g_job_queue.head == NULL)
-            g_job_queue.tail = NULL;
-
-        pthread_mutex_unlock(&g_job_queue.mutex);
-
-
-        // -----------------------------
-        // Log job START
-        // -----------------------------
-        long long start = since_start_ms();
-        if (logf) {
-            fprintf(logf, "TIME %lld: START job %s\n", start, job->line);
-            fflush(logf);
-        }
-
-        // -----------------------------
-        // PARSE JOB LINE
-        // -----------------------------
-        char *copy = strdup(job->line);
-        if (!copy) {
-            report_syscall_error("strdup");
-            goto FINISH_JOB;
-        }
-
-        // Skip the leading word "worker"
-        char *p = copy;
-        while (*p && isspace((unsigned char)*p)) p++;
-        if (strncmp(p, "worker", 6) == 0) p += 6;
-        while (*p && isspace((unsigned char)*p)) p++;
-
-        // Split remaining text by ';'
-        char *basic[128];
-        int n = 0;
-
-        char *tok = strtok(p, ";");
-        while (tok && n < 128) {
-            while (*tok && isspace((unsigned char)*tok)) tok++;
-            basic[n++] = tok;
-            tok = strtok(NULL, ";");
-        }
-
-        // -----------------------------
-        // FIND repeat
-        // -----------------------------
-        int repeat_index = -1;
-        int repeat_times = 1;
-
-        for (int i = 0; i < n; i++) {
-            char *c = basic[i];
-            while (*c && isspace((unsigned char)*c)) c++;
-
-            if (strncmp(c, "repeat", 6) == 0 &&
-                (c[6] == '\0' || isspace((unsigned char)c[6])))
-            {
-                char *q = c + 6;
-                while (*q && isspace((unsigned char)*q)) q++;
-                repeat_times = atoi(q);
-                repeat_index = i;
-                break;
-            }
-        }
 
         // -----------------------------
-        // EXECUTE COMMANDS
+        // Run them in order, then mark the finished ones done at once
         // -----------------------------
-        if (repeat_index == -1) {
-            // No repeat → run all once
-            for (int i = 0; i < n; i++)
-                execute_single_command(basic[i]);
-        }
-        else {
-            // Commands before repeat → once
-            for (int i = 0; i < repeat_index; i++)
-                execute_single_command(basic[i]);
-
-            // Commands after repeat → repeat_times times
-            for (int r = 0; r < repeat_times; r++) {
-                for (int i = repeat_index + 1; i < n; i++)
-                    execute_single_command(basic[i]);
-            }
-        }
-
-        free(copy);
-
-FINISH_JOB:
+        int finished = 0;
+        for (int i = 0; i < n; i++)
+            finished += run_one_job(thread_id, batch[i]);
 
-        // -----------------------------
-        // Log END
-        // -----------------------------
-        long long end = since_start_ms();
-        if (logf) {
-            fprintf(logf, "TIME %lld: END job %s\n", end, job->line);
-            fflush(logf);
-        }
+        // durable=on: not done before their deltas are on disk
+        if (g_durable)
+            wal_commit(thread_id, finished);
 
-        // -----------------------------
-        // Update statistics
-        // -----------------------------
-        long long turnaround = end - job->read_time_ms;
-
-        pthread_mutex_lock(&g_stats.mutex);
-
-        g_stats.sum_turnaround_ms += turnaround;
-
-        if (g_stats.job_count == 0) {
-            g_stats.min_turnaround_ms = turnaround;
-            g_stats.max_turnaround_ms = turnaround;
-        } else {
-            if (turnaround < g_stats.min_turnaround_ms)
-                g_stats.min_turnaround_ms = turnaround;
-            if (turnaround > g_stats.max_turnaround_ms)
-                g_stats.max_turnaround_ms = turnaround;
-        }
-        g_stats.job_count++;
-
-        pthread_mutex_unlock(&g_stats.mutex);
-
-        // -----------------------------
-        // Mark job finished
-        // -----------------------------
-        pthread_mutex_lock(&g_jobs_mutex);
-        g_jobs_in_progress--;
-        if (g_jobs_in_progress == 0)
-            pthread_cond_signal(&g_jobs_zero_cond);
-        pthread_mutex_unlock(&g_jobs_mutex);
-
-        free(job->line);
-        free(job);
+        queue_jobs_done(thread_id, finished);
     }
 
-    if (logf) fclose(logf);
     return NULL;
 }
 
@@ -350,49 +255,33 @@ int init_system(int num_threads, int num_counters, int log_enabled)
     g_num_counters = num_counters;
     g_log_enabled  = log_enabled ? 1 : 0;
 
-    g_start_time_ms = now_ms();
+    g_start_time_ns = now_ns();
 
-    g_job_queue.head = NULL;
-    g_job_queue.tail = NULL;
+    // CPU order for pinned workers (affinity=compact|scatter); prints it
+    if (topo_init() != 0)
+        return -1;
 
-    pthread_mutex_init(&g_job_queue.mutex, NULL);
-    pthread_cond_init(&g_job_queue.has_jobs, NULL);
+    if (queue_init() != 0)
+        return -1;
 
-    pthread_mutex_init(&g_stats.mutex, NULL);
+    if (stats_init(g_num_threads) != 0)
+        return -1;
 
-    // Initialize per-counter mutexes
-    for (int i = 0; i < g_num_counters; i++)
-        pthread_mutex_init(&g_counter_mutex[i], NULL);
+    // Initialize the counter stripe mutexes (a fixed number)
+    for (int i = 0; i < COUNTER_STRIPES; i++)
+        pthread_mutex_init(&g_counter_mutex[i].mutex, NULL);
 
-    // Create counter files
-    for (int i = 0; i < g_num_counters; i++) {
-        char fname[32];
-        sprintf(fname, "count%02d.txt", i);
-        FILE *f = fopen(fname, "w");
-        if (!f) {
-            report_syscall_error("fopen");
-            return -1;
-        }
-        fprintf(f, "0\n");
-        fclose(f);
-    }
+    // Create the counter store (counters.bin, countNN.txt if exported)
+    if (counter_store_init(g_num_counters, g_num_threads) != 0)
+        return -1;
 
-    // Create worker threads
-    g_worker_threads = malloc(sizeof(pthread_t) * g_num_threads);
-    if (!g_worker_threads) {
-        report_syscall_error("malloc");
+    // Timer thread for suspended jobs (msleep=timer only)
+    if (timer_init() != 0)
         return -1;
-    }
 
-    for (int i = 0; i < g_num_threads; i++) {
-        int rc = pthread_create(&g_worker_threads[i], NULL,
-                                worker_thread_main, (void *)(long)i);
-        if (rc != 0) {
-            errno = rc;
-            report_syscall_error("pthread_create");
-            return -1;
-        }
-    }
+    // Start the first worker(s); more are started as jobs pile up
+    if (pool_init(worker_thread_main) != 0)
+        return -1;
 
     return 0;
 }
@@ -403,48 +292,118 @@ int init_system(int num_threads, int num_counters, int log_enabled)
 // ADD A JOB TO THE QUEUE
 // ============================================================================
 
-int enqueue_job(const char *line, long long read_time_ms)
+// Parse + allocate. Returns 0 and *out, 1 for a malformed line (warning
+// printed if warn), -1 on allocation failure.
+static int make_job(const char *line, size_t len, int line_stable,
+                    unsigned int id, int warn, Job **out)
 {
-    Job *job = malloc(sizeof(Job));
-    if (!job) {
-        report_syscall_error("malloc");
-        return -1;
+    // Decode the line now, so a malformed line never takes a worker
+    METRICS_START(t_parse);
+    Job parsed;
+    char bad[256];   // the offending command (truncated) for the warning
+    if (parse_job_line(line, len, g_num_counters, &parsed,
+                       bad, sizeof(bad)) != 0) {
+        if (warn)
+            fprintf(stderr, "hw2: invalid worker command: %s\n", bad);
+        return 1;
     }
 
-    job->line = strdup(line);
-    if (!job->line) {
-        free(job);
-        report_syscall_error("strdup");
+    // Fold counter ops into net deltas
+    long long requested  = job_op_count(&parsed);
+    long long eliminated = optimize_job(&parsed);
+    METRICS_STOP(MET_DISPATCHER, MET_PARSE, t_parse);
+
+    // Copy ops (and the line, unless it is stable) into pooled storage
+    Job *job = job_alloc(line, len, !line_stable, parsed.ops, parsed.num_ops);
+    if (!job)
         return -1;
-    }
 
-    job->read_time_ms = read_time_ms;
+    // Dispatcher-only stats fields
+    g_stats.ops_requested  += requested;
+    g_stats.ops_eliminated += eliminated;
+
+    job->repeat_start = parsed.repeat_start;
+    job->repeat_times = parsed.repeat_times;
+    job->id   = id;
     job->next = NULL;
 
-    // Add to queue
-    pthread_mutex_lock(&g_job_queue.mutex);
+    // Scheduling annotations, and the cost estimate for sched=sjf
+    job->prio        = parsed.prio;
+    job->deadline_ms = parsed.deadline_ms;
+    job->cost_ns     = job_cost_ns(job);
 
-    if (g_job_queue.tail == NULL) {
-        g_job_queue.head = job;
-        g_job_queue.tail = job;
-    } else {
-        g_job_queue.tail->next = job;
-        g_job_queue.tail = job;
-    }
+    // Start at the first op; an empty loop body needs no passes
+    job->pc        = 0;
+    job->iter_left = (job->repeat_start < job->num_ops) ? job->repeat_times : 0;
+    job->started   = 0;
+
+    // place=counter: where jobs on the same counter go
+    job->route = queue_route(job);
+
+    *out = job;
+    return 0;
+}
+
+Job *build_job(const char *line, size_t len, int line_stable, unsigned int id)
+{
+    Job *job;
+    if (make_job(line, len, line_stable, id, 0, &job) != 0)
+        return NULL;
+    return job;
+}
+
+// Jobs read but not handed to the queue yet (dispatcher only)
+static Job *s_batch_head = NULL;
+static Job *s_batch_tail = NULL;
+static int  s_batch_len  = 0;
 
-    pthread_mutex_unlock(&g_job_queue.mutex);
+int flush_jobs(void)
+{
+    if (!s_batch_head)
+        return 0;
+
+    // More jobs than workers: grow the pool first, so the workers that
+    // wake up for the block find their peers already there
+    pool_jobs_coming(s_batch_len);
+
+    // Add to queue (also counts the jobs as in flight)
+    int rc = queue_push_batch(s_batch_head);
+    s_batch_head = NULL;
+    s_batch_tail = NULL;
+    s_batch_len  = 0;
+    return rc;
+}
 
-    // Increase pending job count
-    pthread_mutex_lock(&g_jobs_mutex);
-    g_jobs_in_progress++;
-    pthread_mutex_unlock(&g_jobs_mutex);
+int submit_job(Job *job, long long read_time_ns)
+{
+    job->read_time_ns = read_time_ns;
+    job->due_ns = (job->deadline_ms >= 0)
+                  ? read_time_ns + (long long)job->deadline_ms * 1000000
+                  : NO_DEADLINE;
+    job->next = NULL;
 
-    // Wake one worker
-    pthread_cond_signal(&g_job_queue.has_jobs);
+    if (s_batch_tail)
+        s_batch_tail->next = job;
+    else
+        s_batch_head = job;
+    s_batch_tail = job;
 
+    // A full block goes to the workers right away
+    if (++s_batch_len >= g_queue_batch)
+        return flush_jobs();
     return 0;
 }
 
+int enqueue_job(const char *line, size_t len, int line_stable,
+                long long read_time_ns, unsigned int id)
+{
+    Job *job;
+    int rc = make_job(line, len, line_stable, id, 1, &job);
+    if (rc != 0)
+        return rc;
+    return submit_job(job, read_time_ns);
+}
+
 
 
 // ============================================================================
@@ -453,12 +412,17 @@ int enqueue_job(const char *line, long long read_time_ms)
 
 void dispatcher_wait_for_all_jobs(void)
 {
-    pthread_mutex_lock(&g_jobs_mutex);
+    // The last partial block of jobs, if any
+    if (flush_jobs() != 0)
+        fprintf(stderr, "hw2: enqueue_job failed\n");
 
-    while (g_jobs_in_progress > 0)
-        pthread_cond_wait(&g_jobs_zero_cond, &g_jobs_mutex);
+    queue_wait_all();
 
-    pthread_mutex_unlock(&g_jobs_mutex);
+    // Barrier reached: counter values are observable now
+    counter_store_sync();
+
+    // ...and every job's memory can be recycled in bulk
+    arena_reset();
 }
 
 
@@ -467,32 +431,84 @@ void dispatcher_wait_for_all_jobs(void)
 // Generate stats.txt
 // ============================================================================
 
-int write_stats_file(const char *filename)
+void write_stats(FILE *f)
 {
-    FILE *f = fopen(filename, "w");
-    if (!f) {
-        report_syscall_error("fopen");
-        return -1;
-    }
+    long long total = since_start_ns() / 1000000;
 
-    long long total = now_ms() - g_start_time_ms;
+    // Called at a barrier: no worker is touching its stats
+    static Histogram hist[NUM_STATS];
+    stats_merge(hist);
 
-    pthread_mutex_lock(&g_stats.mutex);
-    long long sum   = g_stats.sum_turnaround_ms;
-    long long min   = g_stats.min_turnaround_ms;
-    long long max   = g_stats.max_turnaround_ms;
-    long long count = g_stats.job_count;
-    pthread_mutex_unlock(&g_stats.mutex);
+    // Recorded in ns; the legacy lines below stay in whole milliseconds
+    const Histogram *t = &hist[STAT_TURNAROUND];
+    long long sum   = t->sum / 1000000;
+    long long min   = t->min / 1000000;
+    long long max   = t->max / 1000000;
+    long long count = t->count;
 
-    double avg = (count > 0) ? (double)sum / (double)count : 0.0;
+    double avg = (count > 0) ? (double)t->sum / (double)count / 1e6 : 0.0;
 
     fprintf(f, "total running time: %lld milliseconds\n", total);
     fprintf(f, "sum of jobs turnaround time: %lld milliseconds\n", sum);
     fprintf(f, "min job turnaround time: %lld milliseconds\n", (count ? min : 0));
     fprintf(f, "average job turnaround time: %f milliseconds\n", avg);
     fprintf(f, "max job turnaround time: %lld milliseconds\n", (count ? max : 0));
+    fprintf(f, "worker ops requested: %lld\n", g_stats.ops_requested);
+    fprintf(f, "worker ops eliminated by folding: %lld\n", g_stats.ops_eliminated);
+
+    static const char *names[NUM_STATS] = {
+        "job turnaround time", "job queue wait time", "job execution time"
+    };
+    for (int k = 0; k < NUM_STATS; k++) {
+        fprintf(f, "%s p50/p90/p99/p99.9: %.3f / %.3f / %.3f / %.3f milliseconds\n",
+                names[k],
+                (double)hist_percentile(&hist[k], 0.50) / 1e6,
+                (double)hist_percentile(&hist[k], 0.90) / 1e6,
+                (double)hist_percentile(&hist[k], 0.99) / 1e6,
+                (double)hist_percentile(&hist[k], 0.999) / 1e6);
+    }
+
+    // Per priority class, once jobs use more than the default one
+    static Histogram prio[PRIO_CLASSES];
+    long long deadline_jobs, deadline_missed;
+    stats_merge_prio(prio, &deadline_jobs, &deadline_missed);
+
+    int annotated = 0;
+    for (int c = 0; c < PRIO_CLASSES; c++)
+        if (c != PRIO_DEFAULT && prio[c].count > 0)
+            annotated = 1;
+    for (int c = 0; annotated && c < PRIO_CLASSES; c++) {
+        if (prio[c].count == 0)
+            continue;
+        fprintf(f, "priority %d jobs: %lld, turnaround p50/p90/p99/p99.9: "
+                   "%.3f / %.3f / %.3f / %.3f milliseconds\n",
+                c, prio[c].count,
+                (double)hist_percentile(&prio[c], 0.50) / 1e6,
+                (double)hist_percentile(&prio[c], 0.90) / 1e6,
+                (double)hist_percentile(&prio[c], 0.99) / 1e6,
+                (double)hist_percentile(&prio[c], 0.999) / 1e6);
+    }
+    if (deadline_jobs > 0)
+        fprintf(f, "jobs with a deadline: %lld, deadlines missed: %lld\n",
+                deadline_jobs, deadline_missed);
+
+    // durable=on only
+    wal_write_stats(f);
+}
+
+int write_stats_file(const char *filename)
+{
+    METRICS_START(t_io);
+    FILE *f = fopen(filename, "w");
+    if (!f) {
+        report_syscall_error("fopen");
+        return -1;
+    }
+
+    write_stats(f);
 
     fclose(f);
+    METRICS_STOP(MET_DISPATCHER, MET_FILE_IO, t_io);
     return 0;
 }
 
@@ -505,22 +521,20 @@ int write_stats_file(const char *filename)
 void shutdown_system(void)
 {
     // Wait for threads to finish
-    if (g_worker_threads) {
-        for (int i = 0; i < g_num_threads; i++)
-            pthread_join(g_worker_threads[i], NULL);
+    pool_join();
 
-        free(g_worker_threads);
-        g_worker_threads = NULL;
-    }
+    // No job is sleeping any more
+    timer_shutdown();
 
     // Destroy mutexes/conds
-    pthread_mutex_destroy(&g_stats.mutex);
-    pthread_mutex_destroy(&g_job_queue.mutex);
-    pthread_cond_destroy(&g_job_queue.has_jobs);
+    queue_destroy();
+    stats_destroy();
+    arena_destroy();
 
-    pthread_mutex_destroy(&g_jobs_mutex);
-    pthread_cond_destroy(&g_jobs_zero_cond);
+    // Final counter values to counters.bin / countNN.txt
+    counter_store_sync();
+    counter_store_close();
 
-    for (int i = 0; i < g_num_counters; i++)
-        pthread_mutex_destroy(&g_counter_mutex[i]);
+    for (int i = 0; i < COUNTER_STRIPES; i++)
+        pthread_mutex_destroy(&g_counter_mutex[i].mutex);
 }
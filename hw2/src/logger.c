@@ -0,0 +1,607 @@
+// ============================================================================
+// logger.c  — Log files, written synchronously or by a logger thread
+// ============================================================================
+//
+// Async mode, producer side: an event is a fixed LogRecord header plus the
+// line text, copied into the sink's single-producer/single-consumer ring.
+// That is a memcpy and one atomic store; no lock, no syscall (unless the
+// ring is full).
+//
+// Logger side: every LOG_FLUSH_MS (or sooner, when a ring gets half full)
+// the logger thread walks all sinks, turns the records into the usual
+// "TIME t: ..." lines in a big buffer and writes each file with one
+// write(). A record's text may arrive in pieces (lines longer than the
+// ring are streamed), so each sink remembers how much text is still due.
+//
+// Binary mode uses the same rings, but only 16-byte TraceRecords go in
+// (plus the line text, once, from the dispatcher). The logger does not
+// look at them: it copies each ring's new bytes to trace.bin as a frame.
+
+#include <fcntl.h>
+#include <sched.h>
+#include "../header/func.h"
+#include "../header/futex.h"
+#include "../header/logger.h"
+#include "../header/trace.h"
+#include "../header/metrics.h"
+
+int g_log_mode = LOG_ASYNC;
+
+#define LOG_OUT_SIZE  (256 * 1024)
+
+typedef struct LogRecord {
+    long long    time_ns;
+    unsigned int type;
+    unsigned int len;        // bytes of text following the header
+} LogRecord;
+
+typedef struct LogRing {
+    _Alignas(CACHE_LINE) _Atomic size_t head;   // written by the producer
+    _Alignas(CACHE_LINE) _Atomic size_t tail;   // written by the logger
+    char buf[LOG_RING_SIZE];
+} LogRing;
+
+typedef struct LogSink {
+    int   fd;                    // binary mode: all sinks share trace.bin
+    _Atomic(LogRing *) ring;     // created by the producer on first use
+
+    // Logger-side parser state
+    int    in_text;
+    size_t text_left;
+} LogSink;
+
+static LogSink   s_sinks[MAX_THREADS + 1];
+static int       s_num_sinks = 0;     // workers + 1 (dispatcher is last)
+
+static pthread_t s_thread;
+static int       s_thread_started = 0;
+static _Atomic int          s_stop     = 0;
+static _Atomic int          s_sleeping = 0;
+static _Atomic unsigned int s_event    = 0;
+
+static char   s_out[LOG_OUT_SIZE];   // logger thread only
+static size_t s_out_len = 0;
+
+static int    s_trace_fd = -1;       // binary mode
+
+// Binary mode string table (dispatcher only): open addressing on the
+// line's hash, text kept in one growing buffer. Ids start at 1.
+typedef struct TraceString {
+    unsigned long long hash;
+    unsigned int       id;       // 0 = empty slot
+    unsigned int       len;
+    size_t             off;      // into s_str_text
+} TraceString;
+
+static TraceString *s_str_slots    = NULL;
+static size_t       s_str_cap      = 0;     // power of two
+static unsigned int s_num_strings  = 0;
+static char        *s_str_text     = NULL;
+static size_t       s_str_text_len = 0;
+static size_t       s_str_text_cap = 0;
+
+static const char *s_prefix[] = {
+    "read cmd line: ",
+    "START job ",
+    "END job ",
+};
+
+
+// ============================================================================
+// OPEN / CLOSE FILES
+// ============================================================================
+
+static int open_sink(LogSink *s, const char *fname)
+{
+    atomic_init(&s->ring, NULL);
+    s->in_text   = 0;
+    s->text_left = 0;
+
+    s->fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (s->fd < 0) {
+        report_syscall_error("open");
+        return -1;
+    }
+    return 0;
+}
+
+
+// ============================================================================
+// PRODUCER SIDE
+// ============================================================================
+
+static void kick_logger(void)
+{
+    atomic_fetch_add(&s_event, 1);
+    futex_wake(&s_event, 1);
+}
+
+static void wake_logger(void)
+{
+    if (atomic_load(&s_sleeping))
+        kick_logger();
+}
+
+static LogRing *get_ring(LogSink *s)
+{
+    LogRing *r = atomic_load_explicit(&s->ring, memory_order_relaxed);
+    if (r)
+        return r;
+
+    r = aligned_alloc(CACHE_LINE, sizeof(LogRing));
+    if (!r) {
+        report_syscall_error("aligned_alloc");
+        return NULL;
+    }
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_store_explicit(&s->ring, r, memory_order_release);
+    return r;
+}
+
+// Copy n bytes into the ring. At least min_chunk bytes go in at once (so a
+// header is never split); text may be written in pieces as room frees up.
+static void ring_write(LogRing *r, const char *data, size_t n, size_t min_chunk)
+{
+    while (n > 0) {
+        size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        size_t room = LOG_RING_SIZE - (head - tail);
+
+        if (room == 0 || room < min_chunk) {
+            // Full: make sure the logger is awake and let it run
+            kick_logger();
+            sched_yield();
+            continue;
+        }
+
+        size_t k   = (n < room) ? n : room;
+        size_t pos = head & (LOG_RING_SIZE - 1);
+        size_t first = LOG_RING_SIZE - pos;
+        if (first > k)
+            first = k;
+
+        memcpy(r->buf + pos, data, first);
+        memcpy(r->buf, data + first, k - first);
+        atomic_store_explicit(&r->head, head + k, memory_order_release);
+
+        data += k;
+        n    -= k;
+    }
+
+    // More than half full: do not wait for the timer
+    size_t used = atomic_load_explicit(&r->head, memory_order_relaxed) -
+                  atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (used > LOG_RING_SIZE / 2)
+        wake_logger();
+}
+
+// Text modes: one "TIME t: ..." line
+static void log_text(LogSink *s, int type, long long time_ns,
+                     const char *line, size_t len)
+{
+    // Sync: one write per event, straight to the file
+    if (g_log_mode == LOG_SYNC) {
+        METRICS_START(t_io);
+        dprintf(s->fd, "TIME %lld: %s%.*s\n",
+                time_ns / 1000000, s_prefix[type], (int)len, line);
+        // Sink i belongs to worker i; the last one to the dispatcher
+        METRICS_STOP((s == &s_sinks[s_num_sinks - 1]) ? MET_DISPATCHER : (int)(s - s_sinks),
+                     MET_FILE_IO, t_io);
+        return;
+    }
+
+    LogRing *r = get_ring(s);
+    if (!r)
+        return;
+
+    LogRecord rec;
+    rec.time_ns = time_ns;
+    rec.type    = (unsigned int)type;
+    rec.len     = (unsigned int)len;
+
+    ring_write(r, (const char *)&rec, sizeof(rec), sizeof(rec));
+    ring_write(r, line, rec.len, 1);
+}
+
+// Binary mode: one TraceRecord plus an optional payload
+static void log_record(LogSink *s, int worker, int event, long long time_ns,
+                       unsigned int job_id, const void *payload, size_t len)
+{
+    LogRing *r = get_ring(s);
+    if (!r)
+        return;
+
+    TraceRecord rec;
+    rec.time_ns = time_ns;
+    rec.job_id  = job_id;
+    rec.event   = (unsigned short)event;
+    rec.worker  = (unsigned short)worker;
+
+    ring_write(r, (const char *)&rec, sizeof(rec), sizeof(rec));
+    ring_write(r, payload, len, 1);
+}
+
+static unsigned long long hash_line(const char *p, size_t n)
+{
+    unsigned long long h = 1469598103934665603ULL;   // FNV-1a
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static int grow_string_table(void)
+{
+    size_t cap = s_str_cap ? s_str_cap * 2 : 1024;
+    TraceString *slots = calloc(cap, sizeof(TraceString));
+    if (!slots)
+        return -1;
+
+    for (size_t i = 0; i < s_str_cap; i++) {
+        if (s_str_slots[i].id == 0)
+            continue;
+        size_t j = s_str_slots[i].hash & (cap - 1);
+        while (slots[j].id != 0)
+            j = (j + 1) & (cap - 1);
+        slots[j] = s_str_slots[i];
+    }
+    free(s_str_slots);
+    s_str_slots = slots;
+    s_str_cap   = cap;
+    return 0;
+}
+
+// String id of line[0 .. len). *is_new is set when the caller must emit
+// the TRACE_STRING record. Without memory the line just gets a fresh id.
+static unsigned int string_id(const char *line, size_t len, int *is_new)
+{
+    *is_new = 1;
+
+    if (2 * (s_num_strings + 1) > s_str_cap && grow_string_table() != 0)
+        return ++s_num_strings;
+
+    unsigned long long h = hash_line(line, len);
+    size_t j = h & (s_str_cap - 1);
+    while (s_str_slots[j].id != 0) {
+        const TraceString *e = &s_str_slots[j];
+        if (e->hash == h && e->len == len &&
+            memcmp(s_str_text + e->off, line, len) == 0) {
+            *is_new = 0;
+            return e->id;
+        }
+        j = (j + 1) & (s_str_cap - 1);
+    }
+
+    // New string: keep a copy for later lookups
+    if (s_str_text_len + len > s_str_text_cap) {
+        size_t cap = s_str_text_cap ? s_str_text_cap : 64 * 1024;
+        while (cap < s_str_text_len + len)
+            cap *= 2;
+        char *text = realloc(s_str_text, cap);
+        if (!text)
+            return ++s_num_strings;
+        s_str_text     = text;
+        s_str_text_cap = cap;
+    }
+    memcpy(s_str_text + s_str_text_len, line, len);
+
+    TraceString *e = &s_str_slots[j];
+    e->hash = h;
+    e->id   = ++s_num_strings;
+    e->len  = (unsigned int)len;
+    e->off  = s_str_text_len;
+    s_str_text_len += len;
+    return e->id;
+}
+
+void log_dispatcher(long long time_ns, unsigned int job_id,
+                    const char *line, size_t len)
+{
+    if (s_num_sinks == 0)
+        return;
+
+    LogSink *s = &s_sinks[s_num_sinks - 1];
+    if (s->fd < 0)
+        return;
+
+    if (g_log_mode != LOG_BINARY) {
+        log_text(s, LOG_READ, time_ns, line, len);
+        return;
+    }
+
+    // The text goes to the trace once per distinct line
+    int is_new;
+    unsigned int sid = string_id(line, len, &is_new);
+    if (is_new && get_ring(s)) {
+        unsigned int len32 = (unsigned int)len;
+        log_record(s, TRACE_DISPATCHER, TRACE_STRING, 0, sid, &len32, sizeof(len32));
+        ring_write(get_ring(s), line, len, 1);
+    }
+    log_record(s, TRACE_DISPATCHER, TRACE_READ, time_ns, job_id, &sid, sizeof(sid));
+}
+
+void log_worker(int worker_id, int type, long long time_ns,
+                unsigned int job_id, const char *line, size_t len)
+{
+    if (s_num_sinks == 0)
+        return;
+
+    LogSink *s = &s_sinks[worker_id];
+    if (s->fd < 0)
+        return;
+
+    if (g_log_mode == LOG_BINARY)
+        log_record(s, worker_id, type, time_ns, job_id, NULL, 0);
+    else
+        log_text(s, type, time_ns, line, len);
+}
+
+
+// ============================================================================
+// LOGGER THREAD
+// ============================================================================
+
+static void write_all(int fd, const char *p, size_t n)
+{
+    METRICS_START(t_io);
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            report_syscall_error("write");
+            return;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    METRICS_STOP(MET_LOGGER, MET_FILE_IO, t_io);
+}
+
+static void out_flush(int fd)
+{
+    if (s_out_len > 0) {
+        write_all(fd, s_out, s_out_len);
+        s_out_len = 0;
+    }
+}
+
+static void out_append(int fd, const char *p, size_t n)
+{
+    while (n > 0) {
+        if (s_out_len == LOG_OUT_SIZE)
+            out_flush(fd);
+        size_t k = LOG_OUT_SIZE - s_out_len;
+        if (k > n)
+            k = n;
+        memcpy(s_out + s_out_len, p, k);
+        s_out_len += k;
+        p += k;
+        n -= k;
+    }
+}
+
+// Copy n bytes starting at ring position pos (wrapping around)
+static void ring_read(const LogRing *r, size_t pos, char *dst, size_t n)
+{
+    size_t off = pos & (LOG_RING_SIZE - 1);
+    size_t first = LOG_RING_SIZE - off;
+    if (first > n)
+        first = n;
+    memcpy(dst, r->buf + off, first);
+    memcpy(dst + first, r->buf, n - first);
+}
+
+// Turn everything currently in the sink's ring into text
+static void drain_sink(LogSink *s)
+{
+    LogRing *r = atomic_load_explicit(&s->ring, memory_order_acquire);
+    if (!r)
+        return;
+
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    while (tail < head) {
+        if (!s->in_text) {
+            if (head - tail < sizeof(LogRecord))
+                break;
+
+            LogRecord rec;
+            ring_read(r, tail, (char *)&rec, sizeof(rec));
+            tail += sizeof(rec);
+
+            char prefix[64];
+            int n = snprintf(prefix, sizeof(prefix), "TIME %lld: %s",
+                             rec.time_ns / 1000000, s_prefix[rec.type]);
+            out_append(s->fd, prefix, (size_t)n);
+
+            s->in_text   = 1;
+            s->text_left = rec.len;
+        }
+
+        // Copy the text straight from the ring to the output buffer
+        size_t k = head - tail;
+        if (k > s->text_left)
+            k = s->text_left;
+
+        while (k > 0) {
+            size_t off   = tail & (LOG_RING_SIZE - 1);
+            size_t piece = LOG_RING_SIZE - off;
+            if (piece > k)
+                piece = k;
+            out_append(s->fd, r->buf + off, piece);
+            tail += piece;
+            s->text_left -= piece;
+            k -= piece;
+        }
+
+        if (s->text_left > 0)
+            break;   // rest of the text not written yet
+
+        out_append(s->fd, "\n", 1);
+        s->in_text = 0;
+    }
+
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+    out_flush(s->fd);
+}
+
+// Binary mode: copy the sink's new bytes to trace.bin as one frame
+static void drain_frame(int sink)
+{
+    LogRing *r = atomic_load_explicit(&s_sinks[sink].ring, memory_order_acquire);
+    if (!r)
+        return;
+
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (head == tail)
+        return;
+
+    TraceFrame f;
+    f.sink = (unsigned int)sink;
+    f.len  = (unsigned int)(head - tail);
+    out_append(s_trace_fd, (const char *)&f, sizeof(f));
+
+    while (tail < head) {
+        size_t off   = tail & (LOG_RING_SIZE - 1);
+        size_t piece = LOG_RING_SIZE - off;
+        if (piece > head - tail)
+            piece = head - tail;
+        out_append(s_trace_fd, r->buf + off, piece);
+        tail += piece;
+    }
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+}
+
+static void *logger_thread_main(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        int stop = atomic_load(&s_stop);
+
+        if (g_log_mode == LOG_BINARY) {
+            for (int i = 0; i < s_num_sinks; i++)
+                drain_frame(i);
+            out_flush(s_trace_fd);
+        } else {
+            for (int i = 0; i < s_num_sinks; i++)
+                if (s_sinks[i].fd >= 0)
+                    drain_sink(&s_sinks[i]);
+        }
+
+        // s_stop is set after the last event, so this pass saw everything
+        if (stop)
+            break;
+
+        unsigned int ev = atomic_load(&s_event);
+        atomic_store(&s_sleeping, 1);
+        futex_wait_ms(&s_event, ev, LOG_FLUSH_MS);
+        atomic_store(&s_sleeping, 0);
+    }
+    return NULL;
+}
+
+
+// ============================================================================
+// INIT / CLOSE
+// ============================================================================
+
+// Text modes: dispatcher.txt and one threadNN.txt per worker
+static int init_text_logs(int num_workers)
+{
+    // The dispatcher log must open; a worker log that fails is skipped
+    if (open_sink(&s_sinks[num_workers], "dispatcher.txt") != 0)
+        return -1;
+    s_num_sinks = num_workers + 1;
+
+    for (int i = 0; i < num_workers; i++) {
+        char fname[32];
+        sprintf(fname, "thread%02d.txt", i);
+        open_sink(&s_sinks[i], fname);
+    }
+    return 0;
+}
+
+// Binary mode: create trace.bin and point every sink at it
+static int open_trace(int num_workers)
+{
+    s_trace_fd = open(TRACE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (s_trace_fd < 0) {
+        report_syscall_error("open");
+        return -1;
+    }
+
+    TraceFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    h.version     = TRACE_VERSION;
+    h.num_workers = (unsigned int)num_workers;
+    write_all(s_trace_fd, (const char *)&h, sizeof(h));
+
+    for (int i = 0; i <= num_workers; i++) {
+        atomic_init(&s_sinks[i].ring, NULL);
+        s_sinks[i].fd = s_trace_fd;
+    }
+    s_num_sinks = num_workers + 1;
+    return 0;
+}
+
+int logger_init(int num_workers)
+{
+    if (g_log_mode == LOG_BINARY) {
+        if (open_trace(num_workers) != 0)
+            return -1;
+    }
+    else {
+        if (init_text_logs(num_workers) != 0)
+            return -1;
+    }
+
+    if (g_log_mode != LOG_SYNC) {
+        int rc = pthread_create(&s_thread, NULL, logger_thread_main, NULL);
+        if (rc != 0) {
+            errno = rc;
+            report_syscall_error("pthread_create");
+            logger_close();
+            return -1;
+        }
+        s_thread_started = 1;
+    }
+    return 0;
+}
+
+void logger_close(void)
+{
+    if (s_num_sinks == 0)
+        return;
+
+    if (s_thread_started) {
+        atomic_store(&s_stop, 1);
+        kick_logger();
+        pthread_join(s_thread, NULL);
+        s_thread_started = 0;
+    }
+
+    for (int i = 0; i < s_num_sinks; i++) {
+        if (g_log_mode != LOG_BINARY && s_sinks[i].fd >= 0)
+            close(s_sinks[i].fd);
+        free(atomic_load(&s_sinks[i].ring));
+    }
+    s_num_sinks = 0;
+
+    if (s_trace_fd >= 0) {
+        close(s_trace_fd);
+        s_trace_fd = -1;
+    }
+    free(s_str_slots);
+    free(s_str_text);
+    s_str_slots = NULL;
+    s_str_text  = NULL;
+    s_str_cap = s_str_text_len = s_str_text_cap = 0;
+    s_num_strings = 0;
+}
@@ -3,113 +3,308 @@
 // ============================================================================
 
 #include "../header/func.h"
+#include "../header/queue.h"
+#include "../header/parse.h"
+#include "../header/arena.h"
+#include "../header/counters.h"
+#include "../header/logger.h"
+#include "../header/reader.h"
+#include "../header/timer.h"
+#include "../header/topo.h"
+#include "../header/metrics.h"
+#include "../header/server.h"
+#include "../header/wal.h"
 
-pthread_mutex_t g_counter_mutex[MAX_COUNTERS]; // one mutex per counter file
+PaddedMutex g_counter_mutex[COUNTER_STRIPES]; // striped counter mutexes (lock mode)
 
-int main(int argc, char *argv[])
+#define READ_AHEAD_MAX  4096    // default limit of jobs staged at a barrier
+
+static int s_read_ahead = READ_AHEAD_MAX;   // "read_ahead=N", 0 = off
+
+// Optional "key=value" arguments after the four required ones.
+// Returns 0 if the option was understood, -1 otherwise.
+static int parse_option(const char *opt)
 {
-    // -----------------------------
-    // 1. Check command line arguments
-    // -----------------------------
-    if (argc != 5) {
-        fprintf(stderr, "hw2: invalid number of arguments\n");
-        fprintf(stderr, "Usage: hw2 <cmdfile> <num_threads> <num_counters> <log_enabled>\n");
-        return 1;
+    if (strcmp(opt, "queue=list") == 0) {
+        g_queue_mode = QUEUE_LIST;
+    }
+    else if (strcmp(opt, "queue=ring") == 0) {
+        g_queue_mode = QUEUE_RING;
+    }
+    else if (strcmp(opt, "queue=steal") == 0) {
+        g_queue_mode = QUEUE_STEAL;
+    }
+    else if (strcmp(opt, "place=rr") == 0) {
+        g_place_mode = PLACE_RR;
+    }
+    else if (strcmp(opt, "place=counter") == 0) {
+        g_place_mode = PLACE_COUNTER;
+    }
+    else if (strcmp(opt, "counters=atomic") == 0) {
+        g_counter_mode = COUNTERS_ATOMIC;
+    }
+    else if (strcmp(opt, "counters=lock") == 0) {
+        g_counter_mode = COUNTERS_LOCK;
+    }
+    else if (strcmp(opt, "counters=delta") == 0) {
+        g_counter_mode = COUNTERS_DELTA;
+    }
+    else if (strcmp(opt, "export=auto") == 0) {
+        g_export_mode = EXPORT_AUTO;
+    }
+    else if (strcmp(opt, "export=text") == 0) {
+        g_export_mode = EXPORT_TEXT;
+    }
+    else if (strcmp(opt, "export=none") == 0) {
+        g_export_mode = EXPORT_NONE;
+    }
+    else if (strcmp(opt, "alloc=malloc") == 0) {
+        g_alloc_mode = ALLOC_MALLOC;
+    }
+    else if (strcmp(opt, "alloc=arena") == 0) {
+        g_alloc_mode = ALLOC_ARENA;
+    }
+    else if (strcmp(opt, "log=async") == 0) {
+        g_log_mode = LOG_ASYNC;
+    }
+    else if (strcmp(opt, "log=sync") == 0) {
+        g_log_mode = LOG_SYNC;
+    }
+    else if (strcmp(opt, "log=binary") == 0) {
+        g_log_mode = LOG_BINARY;
+    }
+    else if (strcmp(opt, "msleep=block") == 0) {
+        g_msleep_mode = MSLEEP_BLOCK;
+    }
+    else if (strcmp(opt, "msleep=timer") == 0) {
+        g_msleep_mode = MSLEEP_TIMER;
+    }
+    else if (strcmp(opt, "affinity=none") == 0) {
+        g_affinity_mode = AFFINITY_NONE;
+    }
+    else if (strcmp(opt, "affinity=compact") == 0) {
+        g_affinity_mode = AFFINITY_COMPACT;
+    }
+    else if (strcmp(opt, "affinity=scatter") == 0) {
+        g_affinity_mode = AFFINITY_SCATTER;
+    }
+    else if (strcmp(opt, "mode=file") == 0) {
+        g_run_mode = MODE_FILE;
+    }
+    else if (strcmp(opt, "mode=serve") == 0) {
+        g_run_mode = MODE_SERVE;
+    }
+    else if (strcmp(opt, "sched=fifo") == 0) {
+        g_sched_mode = SCHEDULE_FIFO;
+    }
+    else if (strcmp(opt, "sched=prio") == 0) {
+        g_sched_mode = SCHEDULE_PRIO;
+    }
+    else if (strcmp(opt, "sched=edf") == 0) {
+        g_sched_mode = SCHEDULE_EDF;
+    }
+    else if (strcmp(opt, "sched=sjf") == 0) {
+        g_sched_mode = SCHEDULE_SJF;
+    }
+    else if (strcmp(opt, "durable=on") == 0) {
+        g_durable = 1;
+    }
+    else if (strcmp(opt, "durable=off") == 0) {
+        g_durable = 0;
+    }
+    else if (strncmp(opt, "commit_us=", 10) == 0) {
+        g_commit_us = atoi(opt + 10);
+        if (g_commit_us < 0)
+            return -1;
+    }
+    else if (strncmp(opt, "commit_jobs=", 12) == 0) {
+        g_commit_jobs = atoi(opt + 12);
+        if (g_commit_jobs < 0)
+            return -1;
+    }
+    else if (strncmp(opt, "snapshot_mb=", 12) == 0) {
+        g_snapshot_mb = atoi(opt + 12);
+        if (g_snapshot_mb <= 0)
+            return -1;
     }
+    else if (strncmp(opt, "read_ahead=", 11) == 0) {
+        s_read_ahead = atoi(opt + 11);
+        if (s_read_ahead < 0)
+            return -1;
+    }
+    else if (strncmp(opt, "batch=", 6) == 0) {
+        g_queue_batch = atoi(opt + 6);
+        if (g_queue_batch < 1 || g_queue_batch > QUEUE_BATCH_MAX)
+            return -1;
+    }
+    else if (strncmp(opt, "ring_size=", 10) == 0) {
+        g_ring_size = atoi(opt + 10);
+        if (g_ring_size <= 0)
+            return -1;
+    }
+    else {
+        return -1;
+    }
+    return 0;
+}
 
-    char *cmd_filename = argv[1];
-    int num_threads    = atoi(argv[2]);
-    int num_counters   = atoi(argv[3]);
-    int log_enabled    = atoi(argv[4]);
+// Next space/tab separated word of [*p, end); returns its length (0: none)
+static size_t next_word(const char **p, const char *end, const char **word)
+{
+    const char *s = *p;
+    while (s < end && (*s == ' ' || *s == '\t')) s++;
+    const char *e = s;
+    while (e < end && *e != ' ' && *e != '\t') e++;
 
-    // Simple sanity checks (range checks are also done in init_system)
-    if (num_threads <= 0 || num_threads > MAX_THREADS ||
-        num_counters <= 0 || num_counters > MAX_COUNTERS ||
-        (log_enabled != 0 && log_enabled != 1)) {
-        fprintf(stderr, "hw2: invalid arguments\n");
-        return 1;
-    }
+    *word = s;
+    *p    = e;
+    return (size_t)(e - s);
+}
 
-    // -----------------------------
-    // 2. Open command file
-    // -----------------------------
-    FILE *cmdfile = fopen(cmd_filename, "r");
-    if (!cmdfile) {
-        report_syscall_error("fopen");
-        return 1;
-    }
 
-    // -----------------------------
-    // 3. Open dispatcher log (if enabled)
-    // -----------------------------
-    FILE *dispatcher_log = NULL;
-    if (log_enabled) {
-        dispatcher_log = fopen("dispatcher.txt", "w");
-        if (!dispatcher_log) {
-            report_syscall_error("fopen");
-            fclose(cmdfile);
-            return 1;
+// ============================================================================
+// READ-AHEAD ACROSS dispatcher_wait
+// ============================================================================
+// While the barrier waits for the last jobs, the dispatcher already reads,
+// parses and allocates the worker lines after it. The staged jobs are
+// logged, time-stamped and queued only once the barrier is passed, so the
+// logs, stats and counters look exactly as if the lines were read then.
+//
+// Staging stops at the first line that is not a valid worker line (it is
+// given back to the reader and handled normally after the barrier), after
+// s_read_ahead jobs, or as soon as nothing is in flight any more.
+
+// Stage the lines after a barrier while jobs are still running. Returns
+// the staged jobs as a list (job->next) in file order.
+static Job *read_ahead(CmdReader *r, int stable, unsigned int *line_id)
+{
+    Job *head = NULL, *tail = NULL;
+    int staged = 0;
+    const char *line;
+    size_t len;
+
+    while (staged < s_read_ahead && !queue_idle()) {
+
+        // A pipe with no full line yet: do not wait for it here
+        if (!stable && !reader_ready(r))
+            break;
+
+        if (reader_next(r, &line, &len) <= 0)
+            break;              // end of file / error: the main loop sees it again
+
+        if (len == 0)
+            continue;
+
+        Job *job = NULL;
+        if (slice_starts(line, len, "worker"))
+            job = build_job(line, len, stable, *line_id + 1);
+        if (!job) {
+            reader_unread(r, line, len);
+            break;
         }
+
+        (*line_id)++;
+        if (tail)
+            tail->next = job;
+        else
+            head = job;
+        tail = job;
+        staged++;
     }
+    return head;
+}
 
-    // -----------------------------
-    // 4. Initialize system (threads, counters, mutexes, etc.)
-    // -----------------------------
-    if (init_system(num_threads, num_counters, log_enabled) != 0) {
-        fprintf(stderr, "hw2: init_system failed\n");
-        if (dispatcher_log) fclose(dispatcher_log);
-        fclose(cmdfile);
-        return 1;
+// After the barrier: log and queue the staged jobs, as if read just now
+static void release_staged(Job *list)
+{
+    while (list) {
+        Job *next = list->next;
+        long long read_time_ns = since_start_ns();
+
+        if (g_log_enabled)
+            log_dispatcher(read_time_ns, list->id, list->line, list->line_len);
+
+        if (submit_job(list, read_time_ns) < 0)
+            fprintf(stderr, "hw2: enqueue_job failed\n");
+        list = next;
     }
 
-    // -----------------------------
-    // 5. Main dispatcher loop: read lines and act
-    // -----------------------------
-    char line[MAX_LINE];
+    // The workers are idle: no reason to wait for a full block
+    if (flush_jobs() < 0)
+        fprintf(stderr, "hw2: enqueue_job failed\n");
+}
+
+// The command file, or the socket and its clients (mode=serve)
+static void close_input(CmdReader *r)
+{
+    if (g_run_mode == MODE_SERVE)
+        server_close();
+    else
+        reader_close(r);
+}
+
+// The cmdfile, line by line, up to its end
+static void dispatch_file(CmdReader *r, const char *name, unsigned int *line_id)
+{
+    // Lines are slices [line, line + len) of the file, without '\n'.
+    // In mmap mode they live until reader_close, so jobs borrow them.
+    const char *line;
+    size_t len;
+    int rc;
+    int stable = reader_stable(r);
 
-    while (fgets(line, sizeof(line), cmdfile)) {
+    for (;;) {
+        // Stream mode: the next read may block until the writer sends
+        // more, so the jobs read so far go to the workers first
+        if (!stable && !reader_ready(r) && flush_jobs() < 0)
+            fprintf(stderr, "hw2: enqueue_job failed\n");
 
-        // Remove trailing newline
-        line[strcspn(line, "\n")] = '\0';
+        if ((rc = reader_next(r, &line, &len)) <= 0)
+            break;
 
         // Skip empty lines
-        if (line[0] == '\0')
+        if (len == 0)
             continue;
 
-        long long read_time = since_start_ms();
+        long long read_time_ns = since_start_ns();
+        (*line_id)++;
 
         // Log that we read this line
-        if (dispatcher_log) {
-            fprintf(dispatcher_log,
-                    "TIME %lld: read cmd line: %s\n",
-                    read_time, line);
-            fflush(dispatcher_log);
-        }
+        if (g_log_enabled)
+            log_dispatcher(read_time_ns, *line_id, line, len);
 
         // -------------------------------------------------
         // Dispatcher commands: "dispatcher msleep X" / "dispatcher wait"
         // -------------------------------------------------
-        if (strncmp(line, "dispatcher", 10) == 0) {
-
-            // Make a copy to safely tokenize by spaces/tabs
-            char tmp[MAX_LINE];
-            strncpy(tmp, line, MAX_LINE - 1);
-            tmp[MAX_LINE - 1] = '\0';
+        if (slice_starts(line, len, "dispatcher")) {
 
-            char *saveptr = NULL;
-            char *tok0 = strtok_r(tmp, " \t", &saveptr); // "dispatcher_msleep" / "dispatcher_wait"
-            char *tok1 = strtok_r(NULL, " \t", &saveptr); // The parameter
+            // Split into words by spaces/tabs (no copy needed)
+            const char *p = line, *end = line + len;
+            const char *tok0, *tok1;
+            size_t n0 = next_word(&p, end, &tok0); // "dispatcher_msleep" / "dispatcher_wait"
+            size_t n1 = next_word(&p, end, &tok1); // The parameter
 
-            if (strcmp(tok0, "dispatcher_msleep") == 0) {
-                if (!tok1) {
+            if (slice_is(tok0, n0, "dispatcher_msleep")) {
+                if (n1 == 0) {
                     fprintf(stderr, "hw2: invalid dispatcher msleep command\n");
                 } else {
-                    int ms = atoi(tok1);
+                    char num[32];
+                    snprintf(num, sizeof(num), "%.*s", (int)n1, tok1);
+                    int ms = atoi(num);
+
+                    // Jobs read so far run while we sleep
+                    if (flush_jobs() < 0)
+                        fprintf(stderr, "hw2: enqueue_job failed\n");
                     msleep_ms(ms);
                 }
             }
-            else if (strcmp(tok0, "dispatcher_wait") == 0) {
+            else if (slice_is(tok0, n0, "dispatcher_wait")) {
+                // Jobs before the barrier first, then read past it
+                if (flush_jobs() < 0)
+                    fprintf(stderr, "hw2: enqueue_job failed\n");
+                Job *staged = read_ahead(r, stable, line_id);
                 dispatcher_wait_for_all_jobs();
+                release_staged(staged);
             }
             else {
                 fprintf(stderr, "hw2: invalid dispatcher command\n");
@@ -119,9 +314,9 @@ int main(int argc, char *argv[])
         // -------------------------------------------------
         // Worker job line: starts with "worker"
         // -------------------------------------------------
-        else if (strncmp(line, "worker", 6) == 0) {
+        else if (slice_starts(line, len, "worker")) {
 
-            if (enqueue_job(line, read_time) != 0) {
+            if (enqueue_job(line, len, stable, read_time_ns, *line_id) < 0) {
                 fprintf(stderr, "hw2: enqueue_job failed\n");
             }
         }
@@ -134,7 +329,99 @@ int main(int argc, char *argv[])
         }
     }
 
-    fclose(cmdfile);
+    if (rc < 0)
+        fprintf(stderr, "hw2: error reading %s\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    // -----------------------------
+    // 1. Check command line arguments
+    // -----------------------------
+    if (argc < 5) {
+        fprintf(stderr, "hw2: invalid number of arguments\n");
+        fprintf(stderr, "Usage: hw2 <cmdfile> <num_threads> <num_counters> <log_enabled> [options]\n"
+                        "       hw2 <socket> <num_threads> <num_counters> <log_enabled> mode=serve [options]\n");
+        fprintf(stderr, "Options: queue=list|ring|steal  ring_size=N  place=rr|counter  batch=N\n"
+                        "         alloc=arena|malloc  counters=atomic|lock|delta  log=async|sync|binary\n"
+                        "         msleep=block|timer  read_ahead=N  affinity=none|compact|scatter\n"
+                        "         export=auto|text|none  mode=file|serve\n"
+                        "         durable=on|off  commit_us=N  commit_jobs=N  snapshot_mb=N\n"
+                        "         sched=fifo|prio|edf|sjf\n");
+        return 1;
+    }
+
+    for (int i = 5; i < argc; i++) {
+        if (parse_option(argv[i]) != 0) {
+            fprintf(stderr, "hw2: invalid option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // Only the list queue can reorder its jobs
+    if (g_sched_mode != SCHEDULE_FIFO && g_queue_mode != QUEUE_LIST) {
+        fprintf(stderr, "hw2: sched=prio|edf|sjf needs queue=list\n");
+        return 1;
+    }
+
+    char *cmd_filename = argv[1];
+    int num_threads    = atoi(argv[2]);
+    int num_counters   = atoi(argv[3]);
+    int log_enabled    = atoi(argv[4]);
+
+    // Simple sanity checks (range checks are also done in init_system)
+    if (num_threads <= 0 || num_threads > MAX_THREADS ||
+        num_counters <= 0 || num_counters > MAX_COUNTERS ||
+        (log_enabled != 0 && log_enabled != 1)) {
+        fprintf(stderr, "hw2: invalid arguments\n");
+        return 1;
+    }
+
+    // -----------------------------
+    // 2. Open command file (mode=serve: the socket, before any thread)
+    // -----------------------------
+    CmdReader cmdfile;
+    if (g_run_mode == MODE_SERVE) {
+        if (server_init(cmd_filename) != 0)
+            return 1;
+    } else if (reader_open(&cmdfile, cmd_filename) != 0) {
+        return 1;
+    }
+
+    // Phase timers (only in a METRICS=1 build)
+    if (metrics_init(num_threads, num_counters) != 0) {
+        close_input(&cmdfile);
+        return 1;
+    }
+
+    // -----------------------------
+    // 3. Open dispatcher + worker logs (if enabled)
+    // -----------------------------
+    if (log_enabled && logger_init(num_threads) != 0) {
+        close_input(&cmdfile);
+        return 1;
+    }
+
+    // -----------------------------
+    // 4. Initialize system (threads, counters, mutexes, etc.)
+    // -----------------------------
+    if (init_system(num_threads, num_counters, log_enabled) != 0) {
+        fprintf(stderr, "hw2: init_system failed\n");
+        logger_close();
+        close_input(&cmdfile);
+        return 1;
+    }
+
+    // -----------------------------
+    // 5. Main dispatcher loop: read lines and act (or serve clients)
+    // -----------------------------
+    unsigned int line_id = 0;   // job id for the logs/trace
+    if (g_run_mode == MODE_SERVE) {
+        if (server_run(&line_id) != 0)
+            fprintf(stderr, "hw2: server failed\n");
+    } else {
+        dispatch_file(&cmdfile, cmd_filename, &line_id);
+    }
 
     // -----------------------------
     // 6. Wait until all jobs finish
@@ -144,8 +431,7 @@ int main(int argc, char *argv[])
     // -----------------------------
     // 7. Tell workers no more jobs are coming and wake them
     // -----------------------------
-    g_dispatcher_done = 1;
-    pthread_cond_broadcast(&g_job_queue.has_jobs);
+    queue_close();
 
     // -----------------------------
     // 8. Write stats.txt
@@ -157,8 +443,16 @@ int main(int argc, char *argv[])
     // -----------------------------
     shutdown_system();
 
-    if (dispatcher_log)
-        fclose(dispatcher_log);
+    // Flush whatever the logger thread has not written yet
+    logger_close();
+
+    // Jobs may have pointed into the mapping; all are gone now
+    close_input(&cmdfile);
+
+    // Every thread has stopped: dump the phase timers (METRICS=1 builds)
+    if (metrics_write(METRICS_FILE) != 0)
+        fprintf(stderr, "hw2: could not write %s\n", METRICS_FILE);
+    metrics_destroy();
 
     return 0;
 }
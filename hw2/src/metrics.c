@@ -0,0 +1,223 @@
+// ============================================================================
+// metrics.c  — Per-thread phase timers and per-stripe counter lock stats
+// ============================================================================
+//
+// Only built into the program with -DHW2_METRICS (see metrics.h).
+
+#include "../header/func.h"
+#include "../header/metrics.h"
+
+#ifdef HW2_METRICS
+
+#include <sys/mman.h>
+#include "../header/futex.h"   // CACHE_LINE
+#include "../header/counters.h"
+
+typedef struct ThreadMetrics {
+    _Alignas(CACHE_LINE) long long ns[NUM_METRICS];
+    long long count[NUM_METRICS];
+    long long queue_locks;  // job queue mutex acquisitions
+} ThreadMetrics;
+
+typedef struct LockMetrics {
+    long long acquired;
+    long long contended;
+    long long wait_ns;
+    long long handoffs;     // taken right after another thread had it
+} LockMetrics;
+
+static ThreadMetrics *s_threads      = NULL;   // num_workers + 3 slots
+static LockMetrics   *s_locks        = NULL;   // [slot][stripe]
+static size_t         s_threads_size = 0;
+static size_t         s_locks_size   = 0;
+static int            s_num_slots    = 0;
+static int            s_num_stripes  = 0;
+static int           *s_last_owner   = NULL;   // per stripe, under its mutex
+
+// Worker ids map to themselves, the other threads go after them
+static int slot_index(int slot)
+{
+    return (slot >= 0) ? slot : s_num_slots + slot;
+}
+
+// Zeroed memory that costs nothing until a slot is used
+static void *zero_pages(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        report_syscall_error("mmap");
+        return NULL;
+    }
+    return p;
+}
+
+int metrics_init(int num_workers, int num_counters)
+{
+    // One entry per counter mutex: the counters share COUNTER_STRIPES
+    s_num_slots    = num_workers + 3;
+    s_num_stripes  = (num_counters < COUNTER_STRIPES) ? num_counters : COUNTER_STRIPES;
+
+    s_threads_size = sizeof(ThreadMetrics) * (size_t)s_num_slots;
+    s_locks_size   = sizeof(LockMetrics) * (size_t)s_num_slots * (size_t)s_num_stripes;
+    if (s_locks_size == 0)
+        s_locks_size = sizeof(LockMetrics);
+
+    s_threads    = zero_pages(s_threads_size);
+    s_locks      = zero_pages(s_locks_size);
+    s_last_owner = calloc((size_t)s_num_stripes + 1, sizeof(int));
+    if (!s_last_owner)
+        report_syscall_error("calloc");
+    return (s_threads && s_locks && s_last_owner) ? 0 : -1;
+}
+
+void metrics_add(int slot, int phase, long long ns)
+{
+    if (!s_threads)
+        return;
+    ThreadMetrics *t = &s_threads[slot_index(slot)];
+    t->ns[phase] += ns;
+    t->count[phase]++;
+}
+
+void metrics_mutex_lock(pthread_mutex_t *m, int slot, int cid)
+{
+    int idx    = slot_index(slot);
+    int stripe = COUNTER_STRIPE(cid);
+    LockMetrics *l = &s_locks[(size_t)idx * (size_t)s_num_stripes + (size_t)stripe];
+
+    // Free: no clock read at all
+    if (pthread_mutex_trylock(m) != 0) {
+        long long t0 = now_ns();
+        pthread_mutex_lock(m);
+        long long waited = now_ns() - t0;
+
+        l->contended++;
+        l->wait_ns += waited;
+        metrics_add(slot, MET_LOCK_WAIT, waited);
+    }
+
+    // We hold the mutex: the owner record is ours to update (stored + 1)
+    l->acquired++;
+    if (s_last_owner[stripe] != idx + 1) {
+        if (s_last_owner[stripe] != 0)
+            l->handoffs++;
+        s_last_owner[stripe] = idx + 1;
+    }
+}
+
+void metrics_queue_lock(pthread_mutex_t *m, int slot)
+{
+    pthread_mutex_lock(m);
+    if (s_threads)
+        s_threads[slot_index(slot)].queue_locks++;
+}
+
+static void slot_name(int slot, char *buf, size_t size)
+{
+    if (slot == slot_index(MET_DISPATCHER))
+        snprintf(buf, size, "dispatcher");
+    else if (slot == slot_index(MET_LOGGER))
+        snprintf(buf, size, "logger");
+    else if (slot == slot_index(MET_TIMER))
+        snprintf(buf, size, "timer");
+    else
+        snprintf(buf, size, "worker %d", slot);
+}
+
+int metrics_write(const char *filename)
+{
+    if (!s_threads)
+        return 0;
+
+    FILE *f = fopen(filename, "w");
+    if (!f) {
+        report_syscall_error("fopen");
+        return -1;
+    }
+
+    static const char *names[NUM_METRICS] = {
+        "queue wait", "parse", "lock wait", "execute", "file I/O"
+    };
+
+    // Totals over all threads
+    long long total_ns[NUM_METRICS] = { 0 }, total_count[NUM_METRICS] = { 0 };
+    long long queue_locks = 0;
+    for (int s = 0; s < s_num_slots; s++) {
+        for (int k = 0; k < NUM_METRICS; k++) {
+            total_ns[k]    += s_threads[s].ns[k];
+            total_count[k] += s_threads[s].count[k];
+        }
+        queue_locks += s_threads[s].queue_locks;
+    }
+
+    fprintf(f, "phase totals (all threads):\n");
+    for (int k = 0; k < NUM_METRICS; k++)
+        fprintf(f, "  %-10s %12.3f ms  %10lld times\n",
+                names[k], (double)total_ns[k] / 1e6, total_count[k]);
+
+    long long handoffs = 0;
+    for (size_t i = 0; i < (size_t)s_num_slots * (size_t)s_num_stripes; i++)
+        handoffs += s_locks[i].handoffs;
+    fprintf(f, "  counter lock handoffs (another thread had it last): %lld\n", handoffs);
+    fprintf(f, "  queue lock acquisitions: %lld\n", queue_locks);
+
+    // Threads that did anything, in ms
+    fprintf(f, "\nper thread (ms):\n");
+    fprintf(f, "  %-12s", "thread");
+    for (int k = 0; k < NUM_METRICS; k++)
+        fprintf(f, " %12s", names[k]);
+    fprintf(f, "\n");
+
+    for (int s = 0; s < s_num_slots; s++) {
+        long long any = 0;
+        for (int k = 0; k < NUM_METRICS; k++)
+            any += s_threads[s].count[k];
+        if (!any)
+            continue;
+
+        char name[32];
+        slot_name(s, name, sizeof(name));
+        fprintf(f, "  %-12s", name);
+        for (int k = 0; k < NUM_METRICS; k++)
+            fprintf(f, " %12.3f", (double)s_threads[s].ns[k] / 1e6);
+        fprintf(f, "\n");
+    }
+
+    // Counter mutexes (lock mode), all threads summed. Stripe c guards
+    // the counters c, c + COUNTER_STRIPES, ...
+    fprintf(f, "\ncounter locks:\n");
+    fprintf(f, "  %-8s %12s %12s %12s %12s\n",
+            "stripe", "acquired", "contended", "wait ms", "handoffs");
+    for (int c = 0; c < s_num_stripes; c++) {
+        LockMetrics sum = { 0, 0, 0, 0 };
+        for (int s = 0; s < s_num_slots; s++) {
+            const LockMetrics *l = &s_locks[(size_t)s * (size_t)s_num_stripes + (size_t)c];
+            sum.acquired  += l->acquired;
+            sum.contended += l->contended;
+            sum.wait_ns   += l->wait_ns;
+            sum.handoffs  += l->handoffs;
+        }
+        if (sum.acquired == 0)
+            continue;
+        fprintf(f, "  %-8d %12lld %12lld %12.3f %12lld\n",
+                c, sum.acquired, sum.contended, (double)sum.wait_ns / 1e6, sum.handoffs);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+void metrics_destroy(void)
+{
+    if (s_threads)
+        munmap(s_threads, s_threads_size);
+    if (s_locks)
+        munmap(s_locks, s_locks_size);
+    free(s_last_owner);
+    s_threads    = NULL;
+    s_locks      = NULL;
+    s_last_owner = NULL;
+}
+
+#endif
@@ -0,0 +1,359 @@
+// ============================================================================
+// parse.c  — Job line parser (runs once per line, on the dispatcher side)
+// ============================================================================
+//
+// A line like "worker msleep 5; repeat 3; increment 1" becomes
+//
+//     ops = { MSLEEP 5, ADD 1 (+1) }, repeat_start = 1, repeat_times = 3
+//
+// so workers never look at the text again. "priority 0; deadline 20"
+// anywhere in the line only annotate the job (see queue.h sched=...).
+
+#include <ctype.h>
+#include <limits.h>
+#include "../header/parse.h"
+
+// Scratch op buffers, reused for every line (dispatcher thread only).
+// s_parsed holds the output of parse_job_line, s_folded of optimize_job.
+static Op    *s_parsed      = NULL;
+static size_t s_parsed_cap  = 0;
+static Op    *s_folded      = NULL;
+static size_t s_folded_cap  = 0;
+
+// Make sure *buf can hold n ops
+static int reserve_ops(Op **buf, size_t *cap, size_t n)
+{
+    if (n <= *cap)
+        return 0;
+
+    size_t new_cap = *cap ? *cap : 64;
+    while (new_cap < n)
+        new_cap *= 2;
+
+    Op *nb = realloc(*buf, sizeof(Op) * new_cap);
+    if (!nb) {
+        report_syscall_error("realloc");
+        return -1;
+    }
+    *buf = nb;
+    *cap = new_cap;
+    return 0;
+}
+
+// Copy the command [p, end) into err for the warning message
+static void set_error(const char *p, const char *end, char *err, size_t err_size)
+{
+    if (!err || err_size == 0)
+        return;
+    size_t n = (size_t)(end - p);
+    if (n >= err_size)
+        n = err_size - 1;
+    memcpy(err, p, n);
+    err[n] = '\0';
+}
+
+// Is the slice [p, p + n) exactly the string s?
+int slice_is(const char *p, size_t n, const char *s)
+{
+    return n == strlen(s) && memcmp(p, s, n) == 0;
+}
+
+// Does the slice [p, p + n) start with the string s?
+int slice_starts(const char *p, size_t n, const char *s)
+{
+    size_t k = strlen(s);
+    return n >= k && memcmp(p, s, k) == 0;
+}
+
+// Does [p, end) start with keyword kw followed by space or end?
+// On success *rest points right after the keyword.
+static int match_keyword(const char *p, const char *end, const char *kw,
+                         const char **rest)
+{
+    size_t n = strlen(kw);
+    if ((size_t)(end - p) < n || memcmp(p, kw, n) != 0)
+        return 0;
+    if (p + n < end && !isspace((unsigned char)p[n]))
+        return 0;
+    *rest = p + n;
+    return 1;
+}
+
+// Parse exactly one decimal integer filling [p, end) (spaces allowed)
+static int parse_int(const char *p, const char *end, int *out)
+{
+    while (p < end && isspace((unsigned char)*p)) p++;
+
+    int neg = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+    if (p >= end || !isdigit((unsigned char)*p))
+        return -1;
+
+    long long v = 0;
+    while (p < end && isdigit((unsigned char)*p)) {
+        v = v * 10 + (*p - '0');
+        if (v > INT_MAX)
+            return -1;
+        p++;
+    }
+
+    while (p < end && isspace((unsigned char)*p)) p++;
+    if (p != end)
+        return -1;
+
+    *out = (int)(neg ? -v : v);
+    return 0;
+}
+
+
+// ============================================================================
+// PARSE ONE LINE
+// ============================================================================
+
+int parse_job_line(const char *line, size_t len, int num_counters,
+                   Job *job, char *err, size_t err_size)
+{
+    const char *p   = line;
+    const char *end = line + len;
+
+    job->ops          = NULL;
+    job->num_ops      = 0;
+    job->repeat_start = 0;
+    job->repeat_times = 0;
+    job->prio         = PRIO_DEFAULT;
+    job->deadline_ms  = -1;
+
+    // Skip the leading word "worker"
+    while (p < end && isspace((unsigned char)*p)) p++;
+    if ((size_t)(end - p) >= 6 && memcmp(p, "worker", 6) == 0) p += 6;
+
+    // Upper bound on the number of ops: one per ';'-separated command
+    int max_ops = 1;
+    for (const char *q = p; q < end; q++)
+        if (*q == ';') max_ops++;
+
+    if (reserve_ops(&s_parsed, &s_parsed_cap, (size_t)max_ops) != 0) {
+        set_error(p, end, err, err_size);
+        return -1;
+    }
+    Op *ops = s_parsed;
+
+    int n = 0;
+    int repeat_start = -1;
+    int repeat_times = 0;
+
+    while (p < end) {
+
+        // Cut the next command [cmd, cmd_end) at ';' and trim spaces
+        const char *cmd = p;
+        const char *semi = memchr(p, ';', (size_t)(end - p));
+        const char *cmd_end = semi ? semi : end;
+        p = semi ? semi + 1 : end;
+
+        while (cmd < cmd_end && isspace((unsigned char)*cmd)) cmd++;
+        while (cmd_end > cmd && isspace((unsigned char)cmd_end[-1])) cmd_end--;
+
+        if (cmd == cmd_end)
+            continue;   // empty command, e.g. trailing ';'
+
+        const char *rest;
+        int val;
+
+        if (match_keyword(cmd, cmd_end, "msleep", &rest) &&
+            parse_int(rest, cmd_end, &val) == 0)
+        {
+            ops[n].code  = OP_MSLEEP;
+            ops[n].arg   = val;
+            ops[n].delta = 0;
+            n++;
+        }
+        else if (match_keyword(cmd, cmd_end, "increment", &rest) &&
+                 parse_int(rest, cmd_end, &val) == 0)
+        {
+            if (val >= 0 && val < num_counters) {
+                ops[n].code  = OP_ADD;
+                ops[n].arg   = val;
+                ops[n].delta = +1;
+                n++;
+            }
+        }
+        else if (match_keyword(cmd, cmd_end, "decrement", &rest) &&
+                 parse_int(rest, cmd_end, &val) == 0)
+        {
+            if (val >= 0 && val < num_counters) {
+                ops[n].code  = OP_ADD;
+                ops[n].arg   = val;
+                ops[n].delta = -1;
+                n++;
+            }
+        }
+        else if (repeat_start < 0 &&
+                 match_keyword(cmd, cmd_end, "repeat", &rest) &&
+                 parse_int(rest, cmd_end, &val) == 0)
+        {
+            // Everything after the (single) repeat is the loop body
+            repeat_start = n;
+            repeat_times = val;
+        }
+        else if (match_keyword(cmd, cmd_end, "priority", &rest) &&
+                 parse_int(rest, cmd_end, &val) == 0 &&
+                 val >= 0 && val < PRIO_CLASSES)
+        {
+            job->prio = val;
+        }
+        else if (match_keyword(cmd, cmd_end, "deadline", &rest) &&
+                 parse_int(rest, cmd_end, &val) == 0 && val >= 0)
+        {
+            job->deadline_ms = val;
+        }
+        else {
+            set_error(cmd, cmd_end, err, err_size);
+            return -1;
+        }
+    }
+
+    job->ops          = ops;
+    job->num_ops      = n;
+    job->repeat_start = (repeat_start < 0) ? n : repeat_start;
+    job->repeat_times = (repeat_start < 0) ? 0 : repeat_times;
+    return 0;
+}
+
+
+
+// ============================================================================
+// FOLDING
+// ============================================================================
+//
+// Counter values are only observable at barriers, so inside one job only
+// the net change per counter matters. Between two msleeps ("a segment")
+// all adds are merged into one add per counter; adds with a net of zero
+// disappear. A repeat body without msleep is folded once and multiplied by
+// repeat_times, e.g. "repeat 24; increment 2" becomes one "add 2, +24".
+// msleeps are kept in place so the job still takes as long as before.
+
+// Merge "counter += delta" into the segment out[seg_start .. *n)
+static void fold_add(Op *out, int seg_start, int *n, int counter, long long delta)
+{
+    for (int i = seg_start; i < *n; i++) {
+        if (out[i].code == OP_ADD && out[i].arg == counter) {
+            out[i].delta += delta;
+            return;
+        }
+    }
+    out[*n].code  = OP_ADD;
+    out[*n].arg   = counter;
+    out[*n].delta = delta;
+    (*n)++;
+}
+
+// Drop the zero adds of out[seg_start .. *n)
+static void drop_zero_adds(Op *out, int seg_start, int *n)
+{
+    int k = seg_start;
+    for (int i = seg_start; i < *n; i++)
+        if (out[i].code != OP_ADD || out[i].delta != 0)
+            out[k++] = out[i];
+    *n = k;
+}
+
+// Fold ops[from .. to) into out (appending at *n). *seg_start is the first
+// op of the open segment and is kept across calls.
+static void fold_range(const Op *ops, int from, int to, long long times,
+                       Op *out, int *n, int *seg_start)
+{
+    for (int i = from; i < to; i++) {
+        if (ops[i].code == OP_ADD) {
+            fold_add(out, *seg_start, n, ops[i].arg, ops[i].delta * times);
+        } else {
+            drop_zero_adds(out, *seg_start, n);
+            out[(*n)++] = ops[i];
+            *seg_start = *n;
+        }
+    }
+}
+
+long long job_op_count(const Job *job)
+{
+    int rs    = job->repeat_start;
+    int times = job->repeat_times > 0 ? job->repeat_times : 0;
+    return (long long)rs + (long long)(job->num_ops - rs) * times;
+}
+
+// a + b for a, b >= 0, stuck at LLONG_MAX instead of overflowing
+static long long add_sat(long long a, long long b)
+{
+    return (a > LLONG_MAX - b) ? LLONG_MAX : a + b;
+}
+
+long long job_cost_ns(const Job *job)
+{
+    long long once = 0, body = 0;
+    for (int i = 0; i < job->num_ops; i++) {
+        const Op *op = &job->ops[i];
+        long long c = JOB_OP_COST_NS;
+        if (op->code == OP_MSLEEP)
+            c = (op->arg > 0) ? (long long)op->arg * 1000000 : 0;
+        if (i < job->repeat_start)
+            once = add_sat(once, c);
+        else
+            body = add_sat(body, c);
+    }
+
+    int times = job->repeat_times > 0 ? job->repeat_times : 0;
+    if (body > 0 && times > (LLONG_MAX - once) / body)
+        return LLONG_MAX;
+    return once + body * times;
+}
+
+long long optimize_job(Job *job)
+{
+    int num_ops = job->num_ops;
+    int rs      = job->repeat_start;
+    int times   = job->repeat_times > 0 ? job->repeat_times : 0;
+
+    long long before = job_op_count(job);
+
+    int body_sleeps = 0;
+    for (int i = rs; i < num_ops; i++)
+        if (job->ops[i].code == OP_MSLEEP) body_sleeps = 1;
+
+    // Folding never adds ops, so a buffer of num_ops is enough
+    if (reserve_ops(&s_folded, &s_folded_cap, (size_t)num_ops) != 0)
+        return 0;   // keep the unoptimized program
+    Op *out = s_folded;
+
+    int n = 0;
+    int seg_start = 0;
+
+    // Commands before repeat
+    fold_range(job->ops, 0, rs, 1, out, &n, &seg_start);
+
+    int new_rs, new_times;
+    if (!body_sleeps) {
+        // Body without msleep: one multiplied add per counter, merged into
+        // the segment before it. No repeat remains.
+        fold_range(job->ops, rs, num_ops, times, out, &n, &seg_start);
+        drop_zero_adds(out, seg_start, &n);
+        new_rs    = n;
+        new_times = 0;
+    } else {
+        // Body with msleep: fold each segment of the body, keep the loop
+        drop_zero_adds(out, seg_start, &n);
+        new_rs = n;
+        seg_start = n;
+        fold_range(job->ops, rs, num_ops, 1, out, &n, &seg_start);
+        drop_zero_adds(out, seg_start, &n);
+        new_times = times;
+    }
+
+    job->ops          = out;
+    job->num_ops      = n;
+    job->repeat_start = new_rs;
+    job->repeat_times = new_times;
+
+    return before - job_op_count(job);
+}
@@ -0,0 +1,110 @@
+// ============================================================================
+// pool.c  — Elastic worker pool: lazy pthread_create, small stacks
+// ============================================================================
+//
+// Only the dispatcher starts workers, so s_threads needs no lock. The
+// count is atomic because the queue reads it (steal mode) from workers
+// and the timer thread.
+
+#include <limits.h>      // PTHREAD_STACK_MIN
+#include <stdatomic.h>
+#include "../header/func.h"
+#include "../header/pool.h"
+#include "../header/queue.h"
+#include "../header/timer.h"
+
+static pthread_t     *s_threads = NULL;   // g_num_threads slots
+static _Atomic int    s_started = 0;
+static int            s_grow_failed = 0;  // stop trying after an error
+static pthread_attr_t s_attr;
+static void *(*s_worker_main)(void *) = NULL;
+
+// Start worker number s_started. Returns 0 or the pthread error.
+static int start_worker(void)
+{
+    int id = atomic_load(&s_started);
+    int rc = pthread_create(&s_threads[id], &s_attr,
+                            s_worker_main, (void *)(long)id);
+    if (rc == 0)
+        atomic_store(&s_started, id + 1);
+    return rc;
+}
+
+int pool_init(void *(*worker_main)(void *))
+{
+    s_worker_main = worker_main;
+
+    s_threads = malloc(sizeof(pthread_t) * (size_t)g_num_threads);
+    if (!s_threads) {
+        report_syscall_error("malloc");
+        return -1;
+    }
+
+    // Small stacks; fall back to the default if the size is refused
+    pthread_attr_init(&s_attr);
+    size_t stack = WORKER_STACK_SIZE;
+    if (stack < (size_t)PTHREAD_STACK_MIN)
+        stack = (size_t)PTHREAD_STACK_MIN;
+    pthread_attr_setstacksize(&s_attr, stack);
+
+    // place=counter sends counter t's jobs to worker t % num_threads for
+    // the whole run, so every worker must be there from the start
+    int n = (g_num_threads < POOL_MIN_WORKERS) ? g_num_threads : POOL_MIN_WORKERS;
+    if (g_queue_mode == QUEUE_STEAL && g_place_mode == PLACE_COUNTER)
+        n = g_num_threads;
+    for (int i = 0; i < n; i++) {
+        int rc = start_worker();
+        if (rc != 0) {
+            errno = rc;
+            report_syscall_error("pthread_create");
+            if (i < POOL_MIN_WORKERS)
+                return -1;
+            s_grow_failed = 1;      // keep going with the workers we have
+            break;
+        }
+    }
+    return 0;
+}
+
+void pool_jobs_coming(int n)
+{
+    int started = atomic_load(&s_started);
+    if (started >= g_num_threads || s_grow_failed)
+        return;
+
+    // Every worker is (or may be) busy: one more per extra job (a
+    // block of jobs may need several). Jobs sleeping on the timer wheel
+    // (msleep=timer) are in flight but need no worker until they resume.
+    long long busy = (long long)queue_in_flight() - timer_suspended() + n;
+    while (busy > started && started < g_num_threads) {
+        int rc = start_worker();
+        if (rc != 0) {
+            // Keep going with the workers we have
+            errno = rc;
+            report_syscall_error("pthread_create");
+            s_grow_failed = 1;
+            break;
+        }
+        started = atomic_load(&s_started);
+    }
+}
+
+int pool_size(void)
+{
+    return atomic_load(&s_started);
+}
+
+void pool_join(void)
+{
+    if (!s_threads)
+        return;
+
+    int n = atomic_load(&s_started);
+    for (int i = 0; i < n; i++)
+        pthread_join(s_threads[i], NULL);
+
+    pthread_attr_destroy(&s_attr);
+    free(s_threads);
+    s_threads = NULL;
+    atomic_store(&s_started, 0);
+}
@@ -0,0 +1,1185 @@
+// ============================================================================
+// queue.c  — Job queue implementations (mutex list / lock-free ring /
+//            work stealing)
+// ============================================================================
+
+#include <stdint.h>
+#include "../header/func.h"
+#include "../header/futex.h"
+#include "../header/queue.h"
+#include "../header/pool.h"
+#include "../header/arena.h"
+#include "../header/metrics.h"
+
+int g_queue_mode  = QUEUE_LIST;
+int g_ring_size   = DEFAULT_RING_SIZE;
+int g_place_mode  = PLACE_RR;
+int g_queue_batch = QUEUE_BATCH_DEFAULT;
+int g_sched_mode  = SCHEDULE_FIFO;
+
+// -------------------------
+// List mode globals
+// -------------------------
+
+JobQueue g_job_queue;
+
+int g_jobs_in_progress = 0;
+pthread_mutex_t g_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  g_jobs_zero_cond = PTHREAD_COND_INITIALIZER;
+
+// Serve mode: eventfd told whenever nothing is in flight any more
+static int s_idle_fd = -1;
+
+
+// ============================================================================
+// IDLE NOTIFICATION (serve mode)
+// ============================================================================
+
+// The in-flight count just reached zero: make the eventfd readable
+static void idle_notify(void)
+{
+    if (s_idle_fd < 0)
+        return;
+
+    // EAGAIN: the counter is already (very) non-zero, it is readable
+    uint64_t one = 1;
+    if (write(s_idle_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        report_syscall_error("write eventfd");
+}
+
+void queue_set_idle_fd(int fd)
+{
+    s_idle_fd = fd;
+}
+
+
+// ============================================================================
+// BATCHES
+// ============================================================================
+
+// How many of depth queued jobs one of share consumers takes at once:
+// its share, at least 1, at most max (the batch=N limit)
+static int batch_take(size_t depth, int share, int max)
+{
+    size_t k = (depth + (size_t)share - 1) / (size_t)share;
+    if (k < 1)
+        k = 1;
+    if (k > (size_t)max)
+        k = (size_t)max;
+    return (int)k;
+}
+
+// Consumers sharing one queue: every worker the pool may start. Not just
+// the ones started so far: the first to wake would take the whole block
+// while the pool is still starting the others for it.
+static int num_consumers(void)
+{
+    return (g_num_threads < 1) ? 1 : g_num_threads;
+}
+
+// Would adding job to a batch of `cost` ns of estimated work exceed the
+// budget? The first job of a batch always fits.
+static int batch_full(long long cost, const Job *job)
+{
+    return cost > 0 && cost + job->cost_ns > QUEUE_BATCH_COST_NS;
+}
+
+
+// ============================================================================
+// SCHEDULING HEAP (list mode, sched=prio|edf|sjf)
+// ============================================================================
+//
+// A binary min-heap of jobs in job_before order, under g_job_queue.mutex.
+// If it cannot grow, jobs go to the FIFO list instead (popped after it).
+
+static Job  **s_heap     = NULL;
+static size_t s_heap_len = 0;
+static size_t s_heap_cap = 0;
+
+// Should job a run before job b?
+static int job_before(const Job *a, const Job *b)
+{
+    if (a->prio != b->prio)
+        return a->prio < b->prio;
+    if (g_sched_mode == SCHEDULE_EDF && a->due_ns != b->due_ns)
+        return a->due_ns < b->due_ns;
+    if (g_sched_mode == SCHEDULE_SJF && a->cost_ns != b->cost_ns)
+        return a->cost_ns < b->cost_ns;
+    return a->id < b->id;
+}
+
+// Returns -1 if the heap is full and cannot grow
+static int heap_push(Job *job)
+{
+    if (s_heap_len == s_heap_cap) {
+        size_t cap = s_heap_cap ? s_heap_cap * 2 : 1024;
+        Job **h = realloc(s_heap, sizeof(Job *) * cap);
+        if (!h)
+            return -1;
+        s_heap     = h;
+        s_heap_cap = cap;
+    }
+
+    // Sift up
+    size_t i = s_heap_len++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!job_before(job, s_heap[parent]))
+            break;
+        s_heap[i] = s_heap[parent];
+        i = parent;
+    }
+    s_heap[i] = job;
+    return 0;
+}
+
+static Job *heap_pop(void)
+{
+    Job *top  = s_heap[0];
+    Job *last = s_heap[--s_heap_len];
+
+    // Sift the last job down from the root
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= s_heap_len)
+            break;
+        if (child + 1 < s_heap_len && job_before(s_heap[child + 1], s_heap[child]))
+            child++;
+        if (!job_before(s_heap[child], last))
+            break;
+        s_heap[i] = s_heap[child];
+        i = child;
+    }
+    if (s_heap_len > 0)
+        s_heap[i] = last;
+    return top;
+}
+
+
+// ============================================================================
+// LIST MODE (mutex + condvar)
+// ============================================================================
+
+// Add the chain first .. last to the FIFO list. Caller holds the mutex.
+static void list_link(Job *first, Job *last)
+{
+    last->next = NULL;
+    if (g_job_queue.tail == NULL) {
+        g_job_queue.head = first;
+        g_job_queue.tail = last;
+    } else {
+        g_job_queue.tail->next = first;
+        g_job_queue.tail = last;
+    }
+}
+
+// Append the chain first .. last (n jobs, linked by job->next) under one
+// lock and wake one sleeper per job, no more than are asleep
+static void list_append(Job *first, Job *last, int n, int slot)
+{
+    last->next = NULL;
+
+    // Add to queue
+    METRICS_QLOCK(&g_job_queue.mutex, slot);
+
+    if (g_sched_mode == SCHEDULE_FIFO) {
+        list_link(first, last);
+    } else {
+        Job *job = first;
+        while (job) {
+            Job *next = job->next;
+            if (heap_push(job) != 0) {
+                list_link(job, last);    // out of memory: FIFO for these
+                break;
+            }
+            job = next;
+        }
+    }
+    g_job_queue.length += n;
+    int sleepers = g_job_queue.sleepers;
+
+    pthread_mutex_unlock(&g_job_queue.mutex);
+
+    // Wake workers (one that goes to sleep after this sees the jobs)
+    if (n >= sleepers) {
+        if (sleepers > 0)
+            pthread_cond_broadcast(&g_job_queue.has_jobs);
+    } else {
+        for (int i = 0; i < n; i++)
+            pthread_cond_signal(&g_job_queue.has_jobs);
+    }
+}
+
+static int list_push(Job *first, Job *last, int n)
+{
+    // Increase pending job count first, so the count never dips to zero
+    // while the jobs are queued
+    METRICS_QLOCK(&g_jobs_mutex, MET_DISPATCHER);
+    g_jobs_in_progress += n;
+    pthread_mutex_unlock(&g_jobs_mutex);
+
+    list_append(first, last, n, MET_DISPATCHER);
+    return 0;
+}
+
+static int list_pop(int worker_id, Job **out, int max)
+{
+    METRICS_QLOCK(&g_job_queue.mutex, worker_id);
+
+    // Wait if queue is empty and more jobs may come
+    while (g_job_queue.length == 0 && g_dispatcher_done == 0) {
+        pthread_mutex_unlock(&g_job_queue.mutex);
+        worker_going_idle(worker_id);
+        METRICS_QLOCK(&g_job_queue.mutex, worker_id);
+
+        if (g_job_queue.length != 0 || g_dispatcher_done)
+            break;
+        g_job_queue.sleepers++;
+        pthread_cond_wait(&g_job_queue.has_jobs, &g_job_queue.mutex);
+        g_job_queue.sleepers--;
+    }
+
+    // No jobs AND dispatcher is done → exit thread
+    if (g_job_queue.length == 0 && g_dispatcher_done == 1) {
+        pthread_mutex_unlock(&g_job_queue.mutex);
+        return 0;
+    }
+
+    // Scheduled: the best job only, the next pick may be a newer one
+    int got = 0;
+    if (s_heap_len > 0) {
+        out[got++] = heap_pop();
+        g_job_queue.length -= got;
+        pthread_mutex_unlock(&g_job_queue.mutex);
+        return got;
+    }
+
+    // Remove our share of the jobs from the queue
+    int k = batch_take((size_t)g_job_queue.length, num_consumers(), max);
+    long long cost = 0;
+    while (got < k && g_job_queue.head && !batch_full(cost, g_job_queue.head)) {
+        Job *job = g_job_queue.head;
+        g_job_queue.head = job->next;
+        cost += job->cost_ns;
+        out[got++] = job;
+    }
+    if (g_job_queue.head == NULL)
+        g_job_queue.tail = NULL;
+    g_job_queue.length -= got;
+
+    pthread_mutex_unlock(&g_job_queue.mutex);
+    return got;
+}
+
+static void list_jobs_done(int worker_id, int n)
+{
+    METRICS_QLOCK(&g_jobs_mutex, worker_id);
+    g_jobs_in_progress -= n;
+    int idle = (g_jobs_in_progress == 0);
+    if (idle)
+        pthread_cond_signal(&g_jobs_zero_cond);
+    pthread_mutex_unlock(&g_jobs_mutex);
+
+    if (idle)
+        idle_notify();
+}
+
+static void list_wait_all(void)
+{
+    pthread_mutex_lock(&g_jobs_mutex);
+
+    while (g_jobs_in_progress > 0)
+        pthread_cond_wait(&g_jobs_zero_cond, &g_jobs_mutex);
+
+    pthread_mutex_unlock(&g_jobs_mutex);
+}
+
+static void list_close(void)
+{
+    pthread_mutex_lock(&g_job_queue.mutex);
+    g_dispatcher_done = 1;
+    pthread_mutex_unlock(&g_job_queue.mutex);
+    pthread_cond_broadcast(&g_job_queue.has_jobs);
+}
+
+
+// ============================================================================
+// RING MODE (lock-free bounded MPMC, Vyukov style)
+// ============================================================================
+//
+// Every slot carries a sequence number. A producer may fill slot i when
+// seq == tail, a consumer may empty it when seq == head + 1. head and tail
+// are claimed with a CAS, so producers and consumers never take a lock.
+//
+// Sleeping uses "eventcounts": a waiter reads the event word, announces
+// itself in *_waiters, re-checks the ring and only then futex-waits on
+// the old event value. The other side bumps the event word and wakes only
+// when someone announced itself, so the fast path is syscall-free.
+
+typedef struct RingSlot {
+    _Atomic size_t seq;
+    Job *job;
+} RingSlot;
+
+typedef struct RingQueue {
+    // Each hot field gets its own cache line so producers and consumers
+    // do not bounce each other's lines.
+    _Alignas(CACHE_LINE) _Atomic size_t head;      // next slot to pop
+    _Alignas(CACHE_LINE) _Atomic size_t tail;      // next slot to push
+
+    _Alignas(CACHE_LINE) _Atomic unsigned int not_empty;   // event word
+    _Atomic int pop_waiters;
+
+    _Alignas(CACHE_LINE) _Atomic unsigned int not_full;    // event word
+    _Atomic int push_waiters;
+
+    // Jobs queued or running. The futex word for dispatcher_wait.
+    _Alignas(CACHE_LINE) _Atomic unsigned int pending;
+    _Atomic int pending_waiters;
+
+    _Alignas(CACHE_LINE) size_t mask;
+    RingSlot *slots;
+    _Atomic int closed;
+} RingQueue;
+
+static RingQueue s_ring;
+
+static int ring_init(void)
+{
+    size_t cap = 2;
+    while (cap < (size_t)g_ring_size)
+        cap <<= 1;
+
+    s_ring.slots = calloc(cap, sizeof(RingSlot));
+    if (!s_ring.slots) {
+        report_syscall_error("calloc");
+        return -1;
+    }
+    for (size_t i = 0; i < cap; i++)
+        atomic_init(&s_ring.slots[i].seq, i);
+
+    s_ring.mask = cap - 1;
+    atomic_init(&s_ring.head, 0);
+    atomic_init(&s_ring.tail, 0);
+    atomic_init(&s_ring.not_empty, 0);
+    atomic_init(&s_ring.not_full, 0);
+    atomic_init(&s_ring.pop_waiters, 0);
+    atomic_init(&s_ring.push_waiters, 0);
+    atomic_init(&s_ring.pending, 0);
+    atomic_init(&s_ring.pending_waiters, 0);
+    atomic_init(&s_ring.closed, 0);
+    return 0;
+}
+
+static int ring_try_push(Job *job)
+{
+    size_t pos = atomic_load_explicit(&s_ring.tail, memory_order_relaxed);
+
+    for (;;) {
+        RingSlot *slot = &s_ring.slots[pos & s_ring.mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        long diff = (long)seq - (long)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak(&s_ring.tail, &pos, pos + 1)) {
+                slot->job = job;
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;   // full
+        } else {
+            pos = atomic_load_explicit(&s_ring.tail, memory_order_relaxed);
+        }
+    }
+}
+
+static Job *ring_try_pop(void)
+{
+    size_t pos = atomic_load_explicit(&s_ring.head, memory_order_relaxed);
+
+    for (;;) {
+        RingSlot *slot = &s_ring.slots[pos & s_ring.mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        long diff = (long)seq - (long)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak(&s_ring.head, &pos, pos + 1)) {
+                Job *job = slot->job;
+                atomic_store_explicit(&slot->seq, pos + s_ring.mask + 1,
+                                      memory_order_release);
+                return job;
+            }
+        } else if (diff < 0) {
+            return NULL;   // empty
+        } else {
+            pos = atomic_load_explicit(&s_ring.head, memory_order_relaxed);
+        }
+    }
+}
+
+// Bump an event word and wake n sleepers, but only if someone is waiting
+static void ring_signal(_Atomic unsigned int *event, _Atomic int *waiters, int n)
+{
+    // Order our ring update before reading the waiter count (pairs with
+    // the fetch_add in the waiter, which is a full barrier)
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(waiters) > 0) {
+        atomic_fetch_add(event, 1);
+        futex_wake(event, n);
+    }
+}
+
+// Put a job in the ring, sleeping while it is full
+static void ring_put(Job *job)
+{
+    while (!ring_try_push(job)) {
+        // Ring full: sleep until a worker frees a slot
+        unsigned int ev = atomic_load(&s_ring.not_full);
+        atomic_fetch_add(&s_ring.push_waiters, 1);
+        if (ring_try_push(job)) {
+            atomic_fetch_sub(&s_ring.push_waiters, 1);
+            break;
+        }
+        futex_wait(&s_ring.not_full, ev);
+        atomic_fetch_sub(&s_ring.push_waiters, 1);
+    }
+
+    ring_signal(&s_ring.not_empty, &s_ring.pop_waiters, 1);
+}
+
+// Put a chain of n jobs in the ring with one wakeup for all of them
+static int ring_push(Job *first, int n)
+{
+    atomic_fetch_add(&s_ring.pending, (unsigned int)n);
+
+    int unsignalled = 0;
+    while (first) {
+        Job *next = first->next;    // a worker may own the job once it is in
+        if (ring_try_push(first)) {
+            unsignalled++;
+        } else {
+            // Full: let the workers at what we put so far before we sleep
+            ring_signal(&s_ring.not_empty, &s_ring.pop_waiters, unsignalled);
+            unsignalled = 0;
+            ring_put(first);
+        }
+        first = next;
+    }
+    if (unsignalled > 0)
+        ring_signal(&s_ring.not_empty, &s_ring.pop_waiters, unsignalled);
+    return 0;
+}
+
+static int ring_pop(int worker_id, Job **out, int max)
+{
+    for (;;) {
+        Job *job = ring_try_pop();
+        if (!job) {
+            worker_going_idle(worker_id);
+
+            // Ring empty: announce ourselves, re-check, then sleep
+            unsigned int ev = atomic_load(&s_ring.not_empty);
+            atomic_fetch_add(&s_ring.pop_waiters, 1);
+
+            job = ring_try_pop();
+            if (!job) {
+                if (atomic_load(&s_ring.closed)) {
+                    atomic_fetch_sub(&s_ring.pop_waiters, 1);
+                    return 0;
+                }
+                futex_wait(&s_ring.not_empty, ev);
+            }
+            atomic_fetch_sub(&s_ring.pop_waiters, 1);
+            if (!job)
+                continue;
+        }
+
+        // Our share of what is left (head first: tail never trails it)
+        size_t head = atomic_load_explicit(&s_ring.head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&s_ring.tail, memory_order_relaxed);
+        int k = batch_take(tail - head + 1, num_consumers(), max);
+
+        // (a popped job cannot go back: stop once the budget is used up)
+        int got = 0;
+        long long cost = job->cost_ns;
+        out[got++] = job;
+        while (got < k && cost < QUEUE_BATCH_COST_NS &&
+               (job = ring_try_pop()) != NULL) {
+            cost += job->cost_ns;
+            out[got++] = job;
+        }
+
+        ring_signal(&s_ring.not_full, &s_ring.push_waiters, got);
+        return got;
+    }
+}
+
+// Atomic in-flight counters (ring and steal modes): n jobs finished
+static void pending_done(_Atomic unsigned int *pending, _Atomic int *waiters, int n)
+{
+    if (atomic_fetch_sub(pending, (unsigned int)n) != (unsigned int)n)
+        return;
+
+    if (atomic_load(waiters) > 0)
+        futex_wake(pending, INT_MAX);
+    idle_notify();
+}
+
+static void pending_wait_zero(_Atomic unsigned int *pending, _Atomic int *waiters)
+{
+    unsigned int v;
+    while ((v = atomic_load(pending)) > 0) {
+        atomic_fetch_add(waiters, 1);
+        v = atomic_load(pending);
+        if (v > 0)
+            futex_wait(pending, v);
+        atomic_fetch_sub(waiters, 1);
+    }
+}
+
+static void ring_close(void)
+{
+    atomic_store(&s_ring.closed, 1);
+    atomic_fetch_add(&s_ring.not_empty, 1);
+    futex_wake(&s_ring.not_empty, INT_MAX);
+}
+
+
+// ============================================================================
+// STEAL MODE (per-worker deques + work stealing)
+// ============================================================================
+//
+// The dispatcher places each job into one worker's deque (round-robin, or
+// by its routing ticket with "place=counter", see queue.h). A worker
+// takes jobs from the front of its own deque; when that is empty it
+// steals half of the jobs from the front of a peer's deque (the oldest
+// ones, which keeps turnaround fair). Each deque has its own lock and
+// cache line, so in the common case a worker only touches its own line.
+// Idle workers sleep on one eventcount, like the ring.
+
+typedef struct WorkerDeque {
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;
+    Job **jobs;               // circular buffer, capacity is a power of 2
+    size_t cap;
+    size_t front;             // index of the oldest job
+    _Atomic size_t count;     // readable without the lock (hint for thieves)
+    _Atomic int owner_idle;   // owner is (about to be) asleep (place=counter)
+    _Atomic unsigned int wake_event;   // owner sleeps here (place=counter)
+} WorkerDeque;
+
+typedef struct StealState {
+    WorkerDeque *deques;
+    int num;
+    int next_rr;              // dispatcher only
+    int requeue_rr;           // timer thread only
+
+    _Alignas(CACHE_LINE) _Atomic unsigned int work_event;
+    _Atomic int sleepers;
+
+    _Alignas(CACHE_LINE) _Atomic unsigned int pending;
+    _Atomic int pending_waiters;
+
+    _Atomic int closed;
+} StealState;
+
+static StealState s_steal;
+
+static int steal_init(void)
+{
+    s_steal.num = g_num_threads;
+    s_steal.next_rr = 0;
+    s_steal.requeue_rr = 0;
+    s_steal.deques = aligned_alloc(CACHE_LINE,
+                                   sizeof(WorkerDeque) * (size_t)s_steal.num);
+    if (!s_steal.deques) {
+        report_syscall_error("aligned_alloc");
+        return -1;
+    }
+    for (int i = 0; i < s_steal.num; i++) {
+        WorkerDeque *d = &s_steal.deques[i];
+        pthread_mutex_init(&d->mutex, NULL);
+        d->jobs  = NULL;
+        d->cap   = 0;
+        d->front = 0;
+        atomic_init(&d->count, 0);
+        atomic_init(&d->owner_idle, 0);
+        atomic_init(&d->wake_event, 0);
+    }
+    atomic_init(&s_steal.work_event, 0);
+    atomic_init(&s_steal.sleepers, 0);
+    atomic_init(&s_steal.pending, 0);
+    atomic_init(&s_steal.pending_waiters, 0);
+    atomic_init(&s_steal.closed, 0);
+    return 0;
+}
+
+static void steal_destroy(void)
+{
+    if (!s_steal.deques)
+        return;
+    for (int i = 0; i < s_steal.num; i++) {
+        pthread_mutex_destroy(&s_steal.deques[i].mutex);
+        free(s_steal.deques[i].jobs);
+    }
+    free(s_steal.deques);
+    s_steal.deques = NULL;
+}
+
+// Append at the back. Caller holds d->mutex.
+static int deque_push_back(WorkerDeque *d, Job *job)
+{
+    size_t n = atomic_load_explicit(&d->count, memory_order_relaxed);
+
+    if (n == d->cap) {
+        size_t new_cap = d->cap ? d->cap * 2 : 64;
+        Job **nj = malloc(sizeof(Job *) * new_cap);
+        if (!nj) {
+            report_syscall_error("malloc");
+            return -1;
+        }
+        for (size_t i = 0; i < n; i++)
+            nj[i] = d->jobs[(d->front + i) & (d->cap - 1)];
+        free(d->jobs);
+        d->jobs  = nj;
+        d->cap   = new_cap;
+        d->front = 0;
+    }
+
+    d->jobs[(d->front + n) & (d->cap - 1)] = job;
+    atomic_store_explicit(&d->count, n + 1, memory_order_relaxed);
+    return 0;
+}
+
+// Remove from the front. Caller holds d->mutex and checked count > 0.
+static Job *deque_pop_front(WorkerDeque *d)
+{
+    Job *job = d->jobs[d->front];
+    d->front = (d->front + 1) & (d->cap - 1);
+    atomic_store_explicit(&d->count,
+                          atomic_load_explicit(&d->count, memory_order_relaxed) - 1,
+                          memory_order_relaxed);
+    return job;
+}
+
+// Deques in use: only workers the pool has started get jobs
+static int steal_active(void)
+{
+    int n = pool_size();
+    return (n < 1) ? 1 : n;
+}
+
+// Which worker gets this job. *rr is the caller's round-robin cursor.
+static int steal_place(const Job *job, int *rr)
+{
+    int n = steal_active();
+
+    // Fixed by the ticket: the pool started every worker for place=counter
+    // (fewer only if a pthread_create failed)
+    if (g_place_mode == PLACE_COUNTER && job->route >= 0) {
+        int w = job->route % g_num_threads;
+        return (w < n) ? w : job->route % n;
+    }
+
+    int w = *rr % n;
+    *rr = (w + 1) % n;
+    return w;
+}
+
+static void wake_owner(WorkerDeque *d)
+{
+    atomic_fetch_add(&d->wake_event, 1);
+    futex_wake(&d->wake_event, 1);
+}
+
+// place=counter: each worker sleeps on its own word, so a job can wake
+// the worker it was routed to rather than any sleeper
+static void affinity_signal(int w)
+{
+    WorkerDeque *d = &s_steal.deques[w];
+
+    // Pairs with the owner_idle store + re-check in steal_pop
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&d->owner_idle)) {
+        wake_owner(d);
+        return;
+    }
+
+    // Owner busy: once a backlog builds up, call in one idle thief
+    if (atomic_load_explicit(&d->count, memory_order_relaxed) < AFFINITY_STEAL_MIN)
+        return;
+    int n = steal_active();
+    for (int k = 1; k < n; k++) {
+        WorkerDeque *t = &s_steal.deques[(w + k) % n];
+        if (atomic_load(&t->owner_idle)) {
+            wake_owner(t);
+            return;
+        }
+    }
+}
+
+// Append to worker w's deque and wake a sleeper
+static int steal_put(Job *job, int w, int slot)
+{
+    WorkerDeque *d = &s_steal.deques[w];
+
+    METRICS_QLOCK(&d->mutex, slot);
+    int rc = deque_push_back(d, job);
+    pthread_mutex_unlock(&d->mutex);
+
+    if (rc == 0) {
+        if (g_place_mode == PLACE_COUNTER)
+            affinity_signal(w);
+        else
+            ring_signal(&s_steal.work_event, &s_steal.sleepers, 1);
+    }
+    return rc;
+}
+
+// Worker w's deque, or (out of memory there) any other one. Returns -1
+// only if no deque can take the job.
+static int steal_put_any(Job *job, int w, int slot)
+{
+    int n = steal_active();
+    for (int k = 0; k < n; k++)
+        if (steal_put(job, (w + k) % n, slot) == 0)
+            return 0;
+    return -1;
+}
+
+// Place a chain of n jobs (n <= QUEUE_BATCH_MAX): each deque that gets
+// some of them is locked once, then the sleepers are woken in one go
+static int steal_push(Job *first, int n)
+{
+    Job *jobs[QUEUE_BATCH_MAX];
+    int  dest[QUEUE_BATCH_MAX];
+    for (int i = 0; i < n; i++, first = first->next) {
+        jobs[i] = first;
+        dest[i] = steal_place(first, &s_steal.next_rr);
+    }
+
+    atomic_fetch_add(&s_steal.pending, (unsigned int)n);
+
+    Job *spill[QUEUE_BATCH_MAX];      // out of memory in their deque
+    int  spill_w[QUEUE_BATCH_MAX];
+    int queued = 0, failed = 0;
+    for (int i = 0; i < n; i++) {
+        if (dest[i] < 0)
+            continue;           // already placed with an earlier job
+
+        int w = dest[i];
+        WorkerDeque *d = &s_steal.deques[w];
+        int put = 0;
+
+        METRICS_QLOCK(&d->mutex, MET_DISPATCHER);
+        for (int j = i; j < n; j++) {
+            if (dest[j] != w)
+                continue;
+            dest[j] = -1;
+            if (deque_push_back(d, jobs[j]) == 0) {
+                put++;
+            } else {
+                spill[failed]   = jobs[j];
+                spill_w[failed] = w;
+                failed++;
+            }
+        }
+        pthread_mutex_unlock(&d->mutex);
+
+        if (put > 0 && g_place_mode == PLACE_COUNTER)
+            affinity_signal(w);
+        queued += put;
+    }
+
+    if (queued > 0 && g_place_mode != PLACE_COUNTER)
+        ring_signal(&s_steal.work_event, &s_steal.sleepers, queued);
+
+    // Spilled jobs: any other deque will do. A job no deque can take is
+    // freed and no longer in flight; the caller reports the failure.
+    int dropped = 0;
+    for (int i = 0; i < failed; i++) {
+        if (steal_put_any(spill[i], spill_w[i] + 1, MET_DISPATCHER) == 0)
+            continue;
+        job_free(spill[i]);
+        dropped++;
+    }
+
+    if (dropped > 0) {
+        pending_done(&s_steal.pending, &s_steal.pending_waiters, dropped);
+        return -1;
+    }
+    return 0;
+}
+
+static void steal_requeue(Job *job)
+{
+    int w = steal_place(job, &s_steal.requeue_rr);
+    if (steal_put_any(job, w, MET_TIMER) != 0)
+        fprintf(stderr, "hw2: cannot requeue a sleeping job\n");
+}
+
+// Take the oldest jobs of our own deque: up to half of them, so thieves
+// still find work there
+static int steal_pop_own(WorkerDeque *d, int self, Job **out, int max)
+{
+    if (atomic_load_explicit(&d->count, memory_order_relaxed) == 0)
+        return 0;
+
+    int got = 0;
+    METRICS_QLOCK(&d->mutex, self);
+    size_t n = atomic_load_explicit(&d->count, memory_order_relaxed);
+    if (n > 0) {
+        int k = batch_take(n, 2, max);
+        long long cost = 0;
+        while (got < k && !batch_full(cost, d->jobs[d->front])) {
+            cost += d->jobs[d->front]->cost_ns;
+            out[got++] = deque_pop_front(d);
+        }
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return got;
+}
+
+// May a thief take jobs from v? With place=counter only from a long
+// backlog, so jobs stay with their counter's worker.
+static int steal_allowed(WorkerDeque *v)
+{
+    size_t n = atomic_load_explicit(&v->count, memory_order_relaxed);
+    if (n == 0)
+        return 0;
+    if (g_place_mode != PLACE_COUNTER)
+        return 1;
+    return n >= AFFINITY_STEAL_MIN;
+}
+
+// Steal half of a peer's jobs: return one, move the rest to our deque
+static Job *steal_from_peers(int self)
+{
+    WorkerDeque *mine = &s_steal.deques[self];
+    int active = steal_active();
+
+    for (int k = 1; k < active; k++) {
+        WorkerDeque *v = &s_steal.deques[(self + k) % active];
+        if (!steal_allowed(v))
+            continue;
+
+        Job *batch[32];
+        int got = 0;
+
+        METRICS_QLOCK(&v->mutex, self);
+        size_t n = atomic_load_explicit(&v->count, memory_order_relaxed);
+        size_t take = (n + 1) / 2;
+        if (take > 32)
+            take = 32;
+        while ((size_t)got < take)
+            batch[got++] = deque_pop_front(v);
+        pthread_mutex_unlock(&v->mutex);
+
+        if (got == 0)
+            continue;
+
+        if (got > 1) {
+            METRICS_QLOCK(&mine->mutex, self);
+            for (int i = 1; i < got; i++) {
+                if (deque_push_back(mine, batch[i]) != 0) {
+                    // Out of memory: give the rest back to the victim
+                    // (it still has room, we just took them out)
+                    pthread_mutex_unlock(&mine->mutex);
+                    METRICS_QLOCK(&v->mutex, self);
+                    for (int j = i; j < got; j++)
+                        deque_push_back(v, batch[j]);
+                    pthread_mutex_unlock(&v->mutex);
+                    return batch[0];
+                }
+            }
+            pthread_mutex_unlock(&mine->mutex);
+        }
+        return batch[0];
+    }
+    return NULL;
+}
+
+// Anything worker self could take?
+static int steal_any_queued(int self)
+{
+    int n = steal_active();
+    for (int i = 0; i < n; i++) {
+        WorkerDeque *d = &s_steal.deques[i];
+        if (i == self ? atomic_load(&d->count) > 0 : steal_allowed(d))
+            return 1;
+    }
+    return 0;
+}
+
+static int steal_pop(int self, Job **out, int max)
+{
+    WorkerDeque *mine = &s_steal.deques[self];
+
+    for (;;) {
+        int got = steal_pop_own(mine, self, out, max);
+        if (got) return got;
+
+        Job *job = steal_from_peers(self);
+        if (job) {
+            out[0] = job;
+            return 1;
+        }
+
+        worker_going_idle(self);
+
+        // Nothing anywhere: announce ourselves, re-check, then sleep
+        // (place=counter: on our own word, a job routed to us wakes us)
+        _Atomic unsigned int *event = (g_place_mode == PLACE_COUNTER)
+                                      ? &mine->wake_event : &s_steal.work_event;
+        unsigned int ev = atomic_load(event);
+        atomic_store(&mine->owner_idle, 1);
+        atomic_fetch_add(&s_steal.sleepers, 1);
+        if (!steal_any_queued(self)) {
+            if (atomic_load(&s_steal.closed)) {
+                atomic_fetch_sub(&s_steal.sleepers, 1);
+                atomic_store(&mine->owner_idle, 0);
+                return 0;
+            }
+            futex_wait(event, ev);
+        }
+        atomic_fetch_sub(&s_steal.sleepers, 1);
+        atomic_store(&mine->owner_idle, 0);
+    }
+}
+
+static void steal_close(void)
+{
+    atomic_store(&s_steal.closed, 1);
+    atomic_fetch_add(&s_steal.work_event, 1);
+    futex_wake(&s_steal.work_event, INT_MAX);
+
+    for (int i = 0; i < s_steal.num; i++)
+        wake_owner(&s_steal.deques[i]);
+}
+
+
+// ============================================================================
+// COUNTER ROUTING (place=counter)
+// ============================================================================
+
+static int       *s_route_of   = NULL;  // ticket + 1 per counter, 0 = none yet
+static long long *s_weight     = NULL;  // per counter, 0 between two calls
+static int        s_next_route = 0;     // dispatcher only
+
+// Tickets and weights for every counter; untouched pages cost nothing
+static int route_init(void)
+{
+    if (g_queue_mode != QUEUE_STEAL || g_place_mode != PLACE_COUNTER)
+        return 0;
+
+    s_route_of = calloc((size_t)g_num_counters, sizeof(int));
+    s_weight   = calloc((size_t)g_num_counters, sizeof(long long));
+    if (!s_route_of || !s_weight) {
+        report_syscall_error("calloc");
+        return -1;
+    }
+    return 0;
+}
+
+int queue_route(const Job *job)
+{
+    if (!s_route_of || !s_weight)
+        return -1;
+
+    // The counter the job updates most often. The program is folded
+    // (optimize_job): an op stands for |delta| updates, and for
+    // repeat_times times that many if it is still in a loop body (a body
+    // without msleep is folded into plain adds with no repeat left)
+    int best = -1;
+    for (int i = 0; i < job->num_ops; i++) {
+        const Op *op = &job->ops[i];
+        if (op->code != OP_ADD || op->arg < 0 || op->arg >= g_num_counters)
+            continue;
+        long long w = llabs(op->delta);
+        if (i >= job->repeat_start && job->repeat_times > 0)
+            w *= job->repeat_times;
+        s_weight[op->arg] += w;
+        if (best < 0 || s_weight[op->arg] > s_weight[best] ||
+            (s_weight[op->arg] == s_weight[best] && op->arg < best))
+            best = op->arg;
+    }
+
+    // Leave the weights zeroed for the next job
+    for (int i = 0; i < job->num_ops; i++) {
+        const Op *op = &job->ops[i];
+        if (op->code == OP_ADD && op->arg >= 0 && op->arg < g_num_counters)
+            s_weight[op->arg] = 0;
+    }
+    if (best < 0)
+        return -1;
+
+    // First time we see this counter: next ticket, so that the counters
+    // in use land on different workers
+    if (s_route_of[best] == 0)
+        s_route_of[best] = ++s_next_route;
+    return s_route_of[best] - 1;
+}
+
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+int queue_init(void)
+{
+    g_job_queue.head     = NULL;
+    g_job_queue.tail     = NULL;
+    g_job_queue.length   = 0;
+    g_job_queue.sleepers = 0;
+
+    pthread_mutex_init(&g_job_queue.mutex, NULL);
+    pthread_cond_init(&g_job_queue.has_jobs, NULL);
+
+    if (route_init() != 0)
+        return -1;
+
+    if (g_queue_mode == QUEUE_RING)
+        return ring_init();
+    if (g_queue_mode == QUEUE_STEAL)
+        return steal_init();
+    return 0;
+}
+
+void queue_destroy(void)
+{
+    pthread_mutex_destroy(&g_job_queue.mutex);
+    pthread_cond_destroy(&g_job_queue.has_jobs);
+
+    pthread_mutex_destroy(&g_jobs_mutex);
+    pthread_cond_destroy(&g_jobs_zero_cond);
+
+    free(s_ring.slots);
+    s_ring.slots = NULL;
+
+    free(s_heap);
+    s_heap     = NULL;
+    s_heap_len = 0;
+    s_heap_cap = 0;
+
+    free(s_route_of);
+    free(s_weight);
+    s_route_of   = NULL;
+    s_weight     = NULL;
+    s_next_route = 0;
+
+    steal_destroy();
+}
+
+int queue_push_batch(Job *list)
+{
+    int rc = 0;
+
+    while (list) {
+        // Cut the next block of up to g_queue_batch jobs
+        Job *last = list;
+        int n = 1;
+        while (n < g_queue_batch && last->next) {
+            last = last->next;
+            n++;
+        }
+        Job *rest = last->next;
+        last->next = NULL;
+
+        int r;
+        switch (g_queue_mode) {
+        case QUEUE_RING:  r = ring_push(list, n);        break;
+        case QUEUE_STEAL: r = steal_push(list, n);       break;
+        default:          r = list_push(list, last, n);
+        }
+        if (r != 0)
+            rc = -1;
+        list = rest;
+    }
+    return rc;
+}
+
+void queue_requeue(Job *job)
+{
+    switch (g_queue_mode) {
+    case QUEUE_RING:  ring_put(job);      break;
+    case QUEUE_STEAL: steal_requeue(job); break;
+    default:          list_append(job, job, 1, MET_TIMER);
+    }
+}
+
+int queue_pop_batch(int worker_id, Job **out, int max)
+{
+    if (max < 1)
+        max = 1;
+    if (max > QUEUE_BATCH_MAX)
+        max = QUEUE_BATCH_MAX;
+
+    switch (g_queue_mode) {
+    case QUEUE_RING:  return ring_pop(worker_id, out, max);
+    case QUEUE_STEAL: return steal_pop(worker_id, out, max);
+    default:          return list_pop(worker_id, out, max);
+    }
+}
+
+void queue_jobs_done(int worker_id, int n)
+{
+    if (n <= 0)
+        return;
+
+    switch (g_queue_mode) {
+    case QUEUE_RING:
+        pending_done(&s_ring.pending, &s_ring.pending_waiters, n);
+        break;
+    case QUEUE_STEAL:
+        pending_done(&s_steal.pending, &s_steal.pending_waiters, n);
+        break;
+    default:
+        list_jobs_done(worker_id, n);
+    }
+}
+
+void queue_wait_all(void)
+{
+    switch (g_queue_mode) {
+    case QUEUE_RING:
+        pending_wait_zero(&s_ring.pending, &s_ring.pending_waiters);
+        break;
+    case QUEUE_STEAL:
+        pending_wait_zero(&s_steal.pending, &s_steal.pending_waiters);
+        break;
+    default:
+        list_wait_all();
+    }
+}
+
+unsigned int queue_in_flight(void)
+{
+    int n;
+
+    switch (g_queue_mode) {
+    case QUEUE_RING:
+        return atomic_load(&s_ring.pending);
+    case QUEUE_STEAL:
+        return atomic_load(&s_steal.pending);
+    default:
+        METRICS_QLOCK(&g_jobs_mutex, MET_DISPATCHER);
+        n = g_jobs_in_progress;
+        pthread_mutex_unlock(&g_jobs_mutex);
+        return (unsigned int)n;
+    }
+}
+
+int queue_idle(void)
+{
+    return queue_in_flight() == 0;
+}
+
+void queue_close(void)
+{
+    switch (g_queue_mode) {
+    case QUEUE_RING:  ring_close();  break;
+    case QUEUE_STEAL: steal_close(); break;
+    default:          list_close();
+    }
+}
@@ -0,0 +1,167 @@
+// ============================================================================
+// reader.c  — Command file reader: one mmap, or big read() chunks
+// ============================================================================
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../header/func.h"
+#include "../header/reader.h"
+
+int reader_open(CmdReader *r, const char *path)
+{
+    memset(r, 0, sizeof(*r));
+
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) {
+        report_syscall_error("open");
+        return -1;
+    }
+
+    // Regular, non-empty file: map it whole
+    struct stat st;
+    if (fstat(r->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+            r->map      = p;
+            r->map_size = (size_t)st.st_size;
+            return 0;
+        }
+    }
+
+    // Otherwise stream it
+    r->buf = malloc(READER_CHUNK);
+    if (!r->buf) {
+        report_syscall_error("malloc");
+        close(r->fd);
+        r->fd = -1;
+        return -1;
+    }
+    r->cap = READER_CHUNK;
+    return 0;
+}
+
+int reader_stable(const CmdReader *r)
+{
+    return r->map != NULL;
+}
+
+// Stream mode: make room and read one more chunk. Returns bytes read.
+static ssize_t fill(CmdReader *r)
+{
+    // Move the unread part to the front
+    if (r->start > 0) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end  -= r->start;
+        r->start = 0;
+    }
+
+    // Still full: the current line is longer than the buffer
+    if (r->cap - r->end < READER_CHUNK / 2) {
+        char *nb = realloc(r->buf, r->cap * 2);
+        if (!nb) {
+            report_syscall_error("realloc");
+            return -1;
+        }
+        r->buf  = nb;
+        r->cap *= 2;
+    }
+
+    while (1) {
+        ssize_t n = read(r->fd, r->buf + r->end, r->cap - r->end);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            report_syscall_error("read");
+        if (n > 0)
+            r->end += (size_t)n;
+        return n;
+    }
+}
+
+int reader_next(CmdReader *r, const char **line, size_t *len)
+{
+    // A line given back (still valid: nothing was read since)
+    if (r->has_back) {
+        r->has_back = 0;
+        *line = r->back;
+        *len  = r->back_len;
+        return 1;
+    }
+
+    if (r->map) {
+        if (r->pos >= r->map_size)
+            return 0;
+
+        const char *p  = r->map + r->pos;
+        size_t     left = r->map_size - r->pos;
+        const char *nl = memchr(p, '\n', left);
+
+        *line = p;
+        *len  = nl ? (size_t)(nl - p) : left;
+        r->pos += *len + (nl ? 1 : 0);
+        return 1;
+    }
+
+    if (r->error)
+        return -1;
+
+    // Stream mode: scan only the bytes not looked at yet
+    size_t scanned = 0;
+    while (1) {
+        char  *p  = r->buf + r->start;
+        size_t n  = r->end - r->start;
+        char  *nl = memchr(p + scanned, '\n', n - scanned);
+
+        if (nl) {
+            *line = p;
+            *len  = (size_t)(nl - p);
+            r->start += *len + 1;
+            return 1;
+        }
+        if (r->eof) {
+            if (n == 0)
+                return 0;
+            *line = p;         // last line without '\n'
+            *len  = n;
+            r->start = r->end;
+            return 1;
+        }
+
+        scanned = n;
+        ssize_t got = fill(r);
+        if (got < 0) {
+            r->error = 1;
+            return -1;
+        }
+        if (got == 0)
+            r->eof = 1;
+    }
+}
+
+int reader_ready(const CmdReader *r)
+{
+    if (r->map || r->has_back || r->eof || r->error)
+        return 1;
+    return r->end > r->start &&
+           memchr(r->buf + r->start, '\n', r->end - r->start) != NULL;
+}
+
+void reader_unread(CmdReader *r, const char *line, size_t len)
+{
+    r->back     = line;
+    r->back_len = len;
+    r->has_back = 1;
+}
+
+void reader_close(CmdReader *r)
+{
+    if (r->map)
+        munmap(r->map, r->map_size);
+    free(r->buf);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
@@ -0,0 +1,559 @@
+// ============================================================================
+// server.c  — Service mode: epoll loop over a UNIX socket (see server.h)
+// ============================================================================
+//
+// Everything runs in the dispatcher thread: the listening socket, every
+// client, a signalfd and an eventfd sit in one epoll set. Client sockets are
+// non-blocking; what a client sends is kept in its own buffer until a
+// whole line is there. The jobs a round of events brings are handed to
+// the workers as one block (flush_jobs).
+//
+// A barrier does not block the loop: the clients are held (taken out of
+// the epoll set, their remaining lines left in their buffers), and the
+// loop waits for an eventfd that the workers write whenever nothing is
+// in flight any more (queue_set_idle_fd). Then the counters are synced
+// as at dispatcher_wait, the waiting clients get "ok" and the held ones
+// are read again.
+
+#define _GNU_SOURCE   // accept4
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "../header/func.h"
+#include "../header/queue.h"
+#include "../header/parse.h"
+#include "../header/counters.h"
+#include "../header/logger.h"
+#include "../header/server.h"
+
+int g_run_mode = MODE_FILE;
+
+#define TAG_LISTEN       SERVER_MAX_CLIENTS         // epoll data of the socket
+#define TAG_SIGNAL       (SERVER_MAX_CLIENTS + 1)   // ...of the signalfd
+#define TAG_IDLE         (SERVER_MAX_CLIENTS + 2)   // ...and of the idle eventfd
+#define MAX_EVENTS       64
+#define READS_PER_EVENT  16       // then let the other clients have a turn
+
+typedef struct Client {
+    int    fd;            // -1: free slot
+    char  *buf;           // SERVER_LINE_MAX bytes received, not handled yet
+    size_t len;
+    int    held;          // lines wait for the barrier (not in the epoll set)
+    int    waiting;       // sent dispatcher_wait, gets "ok" at the barrier
+    int    eof;           // peer has closed its side
+    int    dead;          // close it as soon as possible
+} Client;
+
+static Client s_clients[SERVER_MAX_CLIENTS];
+static int    s_num_clients = 0;
+
+static int    s_epoll  = -1;
+static int    s_listen = -1;
+static int    s_sigfd  = -1;
+static int    s_idlefd = -1;
+static char   s_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static int          s_barrier   = 0;   // clients waiting for a barrier
+static int          s_stop      = 0;
+static long long    s_submitted = 0;   // jobs queued since start
+static unsigned int *s_line_id  = NULL;
+
+// stats.txt lines at the last moment nothing was in flight
+static char     *s_snapshot     = NULL;
+static size_t    s_snapshot_len = 0;
+static long long s_snapshot_ms  = 0;
+
+
+// ============================================================================
+// REPLIES
+// ============================================================================
+
+// Send all of data; a client that does not take its replies is dropped
+static void client_send(Client *c, const char *data, size_t len)
+{
+    while (len > 0 && !c->dead) {
+        ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            c->dead = 1;
+            return;
+        }
+        data += n;
+        len  -= (size_t)n;
+    }
+}
+
+static void client_reply(Client *c, const char *fmt, ...)
+{
+    char msg[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    if (n > (int)sizeof(msg) - 1)
+        n = (int)sizeof(msg) - 1;
+    if (n > 0)
+        client_send(c, msg, (size_t)n);
+}
+
+// Merge the workers' histograms (only valid while nothing is in flight)
+static void take_snapshot(void)
+{
+    free(s_snapshot);
+    s_snapshot     = NULL;
+    s_snapshot_len = 0;
+
+    FILE *f = open_memstream(&s_snapshot, &s_snapshot_len);
+    if (!f) {
+        report_syscall_error("open_memstream");
+        return;
+    }
+    write_stats(f);
+    fclose(f);
+    s_snapshot_ms = since_start_ms();
+}
+
+static void send_stats(Client *c)
+{
+    unsigned int in_flight = queue_in_flight();
+    if (in_flight == 0 && !s_barrier)
+        take_snapshot();
+
+    client_reply(c, "uptime_ms %lld\n", since_start_ms());
+    client_reply(c, "clients %d\n", s_num_clients);
+    client_reply(c, "jobs_submitted %lld\n", s_submitted);
+    client_reply(c, "jobs_in_flight %u\n", in_flight);
+    client_reply(c, "barrier_pending %d\n", s_barrier ? 1 : 0);
+    client_reply(c, "snapshot_ms %lld\n", s_snapshot_ms);
+    if (s_snapshot)
+        client_send(c, s_snapshot, s_snapshot_len);
+    client_reply(c, "end\n");
+}
+
+
+// ============================================================================
+// LINES
+// ============================================================================
+
+#define LINE_DONE       0    // handled, go on
+#define LINE_HOLD_NEXT  1    // handled, hold the client after it
+#define LINE_HOLD       2    // not handled: hold the client, retry later
+
+static int handle_line(Client *c, const char *line, size_t len)
+{
+    // nc/telnet send "\r\n"
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' '))
+        len--;
+    if (len == 0)
+        return LINE_DONE;
+
+    int is_worker = slice_starts(line, len, "worker");
+    int is_disp   = slice_starts(line, len, "dispatcher");
+
+    // -------------------------------------------------
+    // cmdfile lines: as in a file, after a pending barrier
+    // -------------------------------------------------
+    if (is_worker || is_disp) {
+        if (s_barrier)
+            return LINE_HOLD;
+
+        long long read_time_ns = since_start_ns();
+        (*s_line_id)++;
+        if (g_log_enabled)
+            log_dispatcher(read_time_ns, *s_line_id, line, len);
+
+        if (is_worker) {
+            int rc = enqueue_job(line, len, 0, read_time_ns, *s_line_id);
+            if (rc == 0)
+                s_submitted++;
+            else
+                client_reply(c, "error %s\n", rc > 0 ? "invalid worker command"
+                                                     : "enqueue_job failed");
+            return LINE_DONE;
+        }
+
+        if (slice_is(line, len, "dispatcher_wait")) {
+            if (flush_jobs() < 0)
+                fprintf(stderr, "hw2: enqueue_job failed\n");
+            c->waiting = 1;
+            s_barrier++;
+            return LINE_HOLD_NEXT;
+        }
+        if (slice_starts(line, len, "dispatcher_msleep"))
+            client_reply(c, "error dispatcher_msleep is not supported in serve mode\n");
+        else
+            client_reply(c, "error invalid dispatcher command\n");
+        return LINE_DONE;
+    }
+
+    // -------------------------------------------------
+    // Requests
+    // -------------------------------------------------
+    if (slice_starts(line, len, "get ") && len < 32) {
+        char num[32];
+        snprintf(num, sizeof(num), "%.*s", (int)(len - 4), line + 4);
+        char *end;
+        long cid = strtol(num, &end, 10);
+        if (end == num || *end != '\0' || cid < 0 || cid >= g_num_counters)
+            client_reply(c, "error invalid counter\n");
+        else
+            client_reply(c, "%lld\n", counter_get((int)cid));
+    }
+    else if (slice_is(line, len, "stats")) {
+        send_stats(c);
+    }
+    else if (slice_is(line, len, "shutdown")) {
+        client_reply(c, "bye\n");
+        s_stop = 1;
+    }
+    else {
+        client_reply(c, "error unknown command\n");
+    }
+    return LINE_DONE;
+}
+
+
+// ============================================================================
+// CLIENTS
+// ============================================================================
+
+static void client_hold(int idx)
+{
+    Client *c = &s_clients[idx];
+    c->held = 1;
+    epoll_ctl(s_epoll, EPOLL_CTL_DEL, c->fd, NULL);
+}
+
+// Handle the complete lines in the buffer (and a last unterminated one
+// once the peer has closed)
+static void client_process(int idx)
+{
+    Client *c = &s_clients[idx];
+    size_t pos = 0;
+
+    while (!c->dead && !c->held && pos < c->len) {
+        char *start = c->buf + pos;
+        char *nl = memchr(start, '\n', c->len - pos);
+        if (!nl && !c->eof)
+            break;
+
+        size_t len = nl ? (size_t)(nl - start) : c->len - pos;
+        int rc = handle_line(c, start, len);
+        if (rc == LINE_HOLD) {
+            client_hold(idx);
+            break;
+        }
+        pos += len + (nl ? 1 : 0);
+        if (rc == LINE_HOLD_NEXT)
+            client_hold(idx);
+    }
+
+    // Keep what is left at the front
+    if (pos > 0) {
+        memmove(c->buf, c->buf + pos, c->len - pos);
+        c->len -= pos;
+    }
+}
+
+static void client_close(int idx)
+{
+    Client *c = &s_clients[idx];
+    if (c->fd < 0)
+        return;
+
+    if (c->waiting)
+        s_barrier--;
+    if (!c->held)
+        epoll_ctl(s_epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->buf);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    s_num_clients--;
+}
+
+// Done with it: dropped, or closed by the peer with nothing left to do
+static void client_maybe_close(int idx)
+{
+    Client *c = &s_clients[idx];
+    if (c->fd >= 0 && (c->dead || (c->eof && !c->held && !c->waiting)))
+        client_close(idx);
+}
+
+static void client_read(int idx)
+{
+    Client *c = &s_clients[idx];
+
+    for (int r = 0; r < READS_PER_EVENT && !c->held && !c->dead && !c->eof; r++) {
+        if (c->len == SERVER_LINE_MAX) {
+            client_reply(c, "error line too long\n");
+            c->dead = 1;
+            break;
+        }
+
+        ssize_t n = read(c->fd, c->buf + c->len, SERVER_LINE_MAX - c->len);
+        if (n > 0) {
+            c->len += (size_t)n;
+        } else if (n == 0) {
+            c->eof = 1;
+        } else {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                c->dead = 1;
+            break;
+        }
+        client_process(idx);
+    }
+    client_maybe_close(idx);
+}
+
+static void accept_clients(void)
+{
+    for (;;) {
+        int fd = accept4(s_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                report_syscall_error("accept4");
+            return;
+        }
+
+        int idx = 0;
+        while (idx < SERVER_MAX_CLIENTS && s_clients[idx].fd >= 0)
+            idx++;
+        char *buf = (idx < SERVER_MAX_CLIENTS) ? malloc(SERVER_LINE_MAX) : NULL;
+        if (!buf) {
+            static const char msg[] = "error too many clients\n";
+            if (send(fd, msg, sizeof(msg) - 1, MSG_NOSIGNAL) < 0) {
+                // closing it anyway
+            }
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (unsigned int)idx };
+        if (epoll_ctl(s_epoll, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            report_syscall_error("epoll_ctl");
+            free(buf);
+            close(fd);
+            continue;
+        }
+
+        Client *c = &s_clients[idx];
+        memset(c, 0, sizeof(*c));
+        c->fd  = fd;
+        c->buf = buf;
+        s_num_clients++;
+    }
+}
+
+
+// ============================================================================
+// BARRIER
+// ============================================================================
+
+static void finish_barrier(void)
+{
+    // Nothing in flight: sync the counters, recycle job memory
+    dispatcher_wait_for_all_jobs();
+    take_snapshot();
+
+    long long done = s_submitted;
+    s_barrier = 0;
+
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+        Client *c = &s_clients[i];
+        if (c->fd >= 0 && c->waiting) {
+            c->waiting = 0;
+            client_reply(c, "ok %lld\n", done);
+        }
+    }
+
+    // Read the held clients again (one of them may start the next barrier)
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+        Client *c = &s_clients[i];
+        if (c->fd < 0 || !c->held)
+            continue;
+
+        c->held = 0;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (unsigned int)i };
+        if (epoll_ctl(s_epoll, EPOLL_CTL_ADD, c->fd, &ev) != 0) {
+            report_syscall_error("epoll_ctl");
+            c->held = 1;        // not in the set: must not be removed
+            c->dead = 1;
+        } else {
+            client_process(i);
+        }
+        client_maybe_close(i);
+    }
+}
+
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+int server_init(const char *path)
+{
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+        s_clients[i].fd = -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "hw2: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // A socket left behind by an earlier run
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    s_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s_listen < 0) {
+        report_syscall_error("socket");
+        return -1;
+    }
+    if (bind(s_listen, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        report_syscall_error("bind");
+        server_close();
+        return -1;
+    }
+    strcpy(s_path, path);
+    if (listen(s_listen, SERVER_BACKLOG) != 0) {
+        report_syscall_error("listen");
+        server_close();
+        return -1;
+    }
+
+    // SIGINT/SIGTERM: blocked here, before any thread exists, so every
+    // thread inherits the mask and only the signalfd sees them
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    s_sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (s_sigfd < 0) {
+        report_syscall_error("signalfd");
+        server_close();
+        return -1;
+    }
+
+    // Workers: "nothing in flight" (ends a barrier)
+    s_idlefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s_idlefd < 0) {
+        report_syscall_error("eventfd");
+        server_close();
+        return -1;
+    }
+    queue_set_idle_fd(s_idlefd);
+
+    s_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (s_epoll < 0) {
+        report_syscall_error("epoll_create1");
+        server_close();
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = TAG_LISTEN };
+    struct epoll_event sv = { .events = EPOLLIN, .data.u32 = TAG_SIGNAL };
+    struct epoll_event iv = { .events = EPOLLIN, .data.u32 = TAG_IDLE };
+    if (epoll_ctl(s_epoll, EPOLL_CTL_ADD, s_listen, &ev) != 0 ||
+        epoll_ctl(s_epoll, EPOLL_CTL_ADD, s_sigfd, &sv) != 0 ||
+        epoll_ctl(s_epoll, EPOLL_CTL_ADD, s_idlefd, &iv) != 0) {
+        report_syscall_error("epoll_ctl");
+        server_close();
+        return -1;
+    }
+
+    printf("hw2: serving on %s\n", path);
+    fflush(stdout);
+    return 0;
+}
+
+int server_run(unsigned int *line_id)
+{
+    s_line_id = line_id;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!s_stop) {
+        int n = epoll_wait(s_epoll, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            report_syscall_error("epoll_wait");
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            unsigned int tag = events[i].data.u32;
+            if (tag == TAG_LISTEN) {
+                accept_clients();
+            } else if (tag == TAG_SIGNAL) {
+                struct signalfd_siginfo si;
+                if (read(s_sigfd, &si, sizeof(si)) > 0)
+                    s_stop = 1;
+            } else if (tag == TAG_IDLE) {
+                // Reset it; queue_idle below decides (jobs may have come since)
+                uint64_t count;
+                if (read(s_idlefd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                    report_syscall_error("read eventfd");
+            } else if (s_clients[tag].fd >= 0 && !s_clients[tag].held) {
+                client_read((int)tag);
+            }
+        }
+
+        // What this round brought goes to the workers as one block
+        if (flush_jobs() < 0)
+            fprintf(stderr, "hw2: enqueue_job failed\n");
+
+        if (s_barrier && queue_idle())
+            finish_barrier();
+    }
+
+    // Stopping: a pending barrier still gets its answer
+    if (s_barrier)
+        finish_barrier();
+    return 0;
+}
+
+void server_close(void)
+{
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+        if (s_clients[i].fd >= 0)
+            client_close(i);
+
+    if (s_epoll >= 0)
+        close(s_epoll);
+    if (s_sigfd >= 0)
+        close(s_sigfd);
+    if (s_idlefd >= 0) {
+        queue_set_idle_fd(-1);
+        close(s_idlefd);
+    }
+    if (s_listen >= 0)
+        close(s_listen);
+    if (s_path[0])
+        unlink(s_path);
+
+    s_epoll  = -1;
+    s_sigfd  = -1;
+    s_idlefd = -1;
+    s_listen = -1;
+    s_path[0] = '\0';
+
+    free(s_snapshot);
+    s_snapshot     = NULL;
+    s_snapshot_len = 0;
+}
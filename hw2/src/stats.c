@@ -0,0 +1,179 @@
+// ============================================================================
+// stats.c  — Log-linear latency histograms, one set per worker
+// ============================================================================
+
+#include <sys/mman.h>
+#include "../header/func.h"
+#include "../header/futex.h"   // CACHE_LINE
+#include "../header/stats.h"
+
+// A worker's histograms start on their own cache line
+typedef struct WorkerStats {
+    _Alignas(CACHE_LINE) Histogram hist[NUM_STATS];
+    Histogram prio[PRIO_CLASSES];     // turnaround per priority class
+    long long deadline_jobs;
+    long long deadline_missed;
+} WorkerStats;
+
+static WorkerStats *s_worker_stats = NULL;
+static int          s_num_workers  = 0;
+
+
+// ============================================================================
+// HISTOGRAM
+// ============================================================================
+
+// Values < HIST_SUB map to themselves. Above that, with e = msb - SUB_BITS,
+// v lands in e * HIST_SUB + (v >> e), i.e. HIST_SUB buckets per octave.
+static int bucket_of(long long v)
+{
+    if (v < HIST_SUB)
+        return (v < 0) ? 0 : (int)v;
+    if (v >= (1LL << HIST_MAX_BITS))
+        return HIST_BUCKETS - 1;
+
+    int msb = 63 - __builtin_clzll((unsigned long long)v);
+    int e   = msb - HIST_SUB_BITS;
+    return e * HIST_SUB + (int)(v >> e);
+}
+
+// Smallest value and width of bucket i
+static void bucket_range(int i, long long *low, long long *width)
+{
+    if (i < 2 * HIST_SUB) {
+        *low   = i;
+        *width = 1;
+        return;
+    }
+    int e  = i / HIST_SUB - 1;
+    *low   = (long long)(i - e * HIST_SUB) << e;
+    *width = 1LL << e;
+}
+
+void hist_add(Histogram *h, long long v)
+{
+    if (h->count == 0 || v < h->min)
+        h->min = v;
+    if (h->count == 0 || v > h->max)
+        h->max = v;
+    h->count++;
+    h->sum += v;
+    h->bucket[bucket_of(v)]++;
+}
+
+void hist_merge(Histogram *dst, const Histogram *src)
+{
+    if (src->count == 0)
+        return;
+    if (dst->count == 0 || src->min < dst->min)
+        dst->min = src->min;
+    if (dst->count == 0 || src->max > dst->max)
+        dst->max = src->max;
+    dst->count += src->count;
+    dst->sum   += src->sum;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        dst->bucket[i] += src->bucket[i];
+}
+
+long long hist_percentile(const Histogram *h, double p)
+{
+    if (h->count == 0)
+        return 0;
+
+    // Rank of the wanted sample, 1-based
+    long long rank = (long long)(p * (double)h->count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > h->count)
+        rank = h->count;
+
+    long long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen < rank)
+            continue;
+
+        // Middle of the bucket, kept inside the exact min/max
+        long long low, width;
+        bucket_range(i, &low, &width);
+        long long v = low + (width - 1) / 2;
+        if (v < h->min)
+            v = h->min;
+        if (v > h->max)
+            v = h->max;
+        return v;
+    }
+    return h->max;
+}
+
+
+// ============================================================================
+// PER-WORKER STATS
+// ============================================================================
+
+int stats_init(int num_workers)
+{
+    size_t size = sizeof(WorkerStats) * (size_t)num_workers;
+
+    // Fresh anonymous pages are already zero and page aligned; the
+    // histograms of workers the pool never starts are never touched, and
+    // the others are first touched by their (maybe pinned) worker
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        report_syscall_error("mmap");
+        return -1;
+    }
+    s_worker_stats = p;
+    s_num_workers  = num_workers;
+    return 0;
+}
+
+void stats_record(int worker_id, int prio, long long turnaround,
+                  long long queue_wait, long long exec)
+{
+    WorkerStats *ws = &s_worker_stats[worker_id];
+    Histogram *h = ws->hist;
+    hist_add(&h[STAT_TURNAROUND], turnaround);
+    hist_add(&h[STAT_QUEUE_WAIT], queue_wait);
+    hist_add(&h[STAT_EXEC], exec);
+    hist_add(&ws->prio[prio], turnaround);
+}
+
+void stats_deadline(int worker_id, int missed)
+{
+    WorkerStats *ws = &s_worker_stats[worker_id];
+    ws->deadline_jobs++;
+    if (missed)
+        ws->deadline_missed++;
+}
+
+void stats_merge(Histogram out[NUM_STATS])
+{
+    memset(out, 0, sizeof(Histogram) * NUM_STATS);
+    for (int w = 0; w < s_num_workers; w++)
+        for (int k = 0; k < NUM_STATS; k++)
+            hist_merge(&out[k], &s_worker_stats[w].hist[k]);
+}
+
+void stats_merge_prio(Histogram out[PRIO_CLASSES], long long *deadline_jobs,
+                      long long *deadline_missed)
+{
+    memset(out, 0, sizeof(Histogram) * PRIO_CLASSES);
+    *deadline_jobs   = 0;
+    *deadline_missed = 0;
+    for (int w = 0; w < s_num_workers; w++) {
+        for (int c = 0; c < PRIO_CLASSES; c++)
+            hist_merge(&out[c], &s_worker_stats[w].prio[c]);
+        *deadline_jobs   += s_worker_stats[w].deadline_jobs;
+        *deadline_missed += s_worker_stats[w].deadline_missed;
+    }
+}
+
+void stats_destroy(void)
+{
+    if (s_worker_stats)
+        munmap(s_worker_stats, sizeof(WorkerStats) * (size_t)s_num_workers);
+    s_worker_stats = NULL;
+    s_num_workers  = 0;
+}
@@ -0,0 +1,222 @@
+// ============================================================================
+// timer.c  — Timer thread + hierarchical timer wheel (msleep=timer)
+// ============================================================================
+//
+// Workers never touch the wheel: timer_add pushes the job on a lock-free
+// stack (job->next), and the timer thread moves it into the wheel. Only
+// the timer thread reads or writes the wheel, so it needs no lock.
+//
+// Slot choice (like the Linux timer wheel): a job due at tick t goes to
+// the lowest level L where t and now are in the same level-(L+1) slot,
+// in slot (t >> 6L) & 63 of that level. When now enters a new level-L
+// slot, that slot's jobs are re-inserted one level down (cascade).
+
+#include "../header/func.h"
+#include "../header/futex.h"
+#include "../header/queue.h"
+#include "../header/timer.h"
+
+int g_msleep_mode = MSLEEP_BLOCK;
+
+static Job *s_wheel[WHEEL_LEVELS][WHEEL_SLOTS];   // timer thread only
+static long long s_now   = 0;      // current tick (whole ms since start)
+static long long s_count = 0;      // jobs on the wheel
+
+static _Atomic(Job *)       s_incoming = NULL;   // timer_add → timer thread
+static _Atomic unsigned int s_event    = 0;
+static _Atomic int          s_sleeping = 0;
+static _Atomic int          s_stop     = 0;
+static _Atomic int          s_suspended = 0;     // timer_add .. expire
+
+static pthread_t s_thread;
+static int       s_started = 0;
+
+
+// ============================================================================
+// WHEEL (timer thread only)
+// ============================================================================
+
+// First tick at or after the job's wake time: it never fires early
+static long long due_tick(const Job *job)
+{
+    return (job->wake_ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS;
+}
+
+static void wheel_insert(Job *job)
+{
+    long long t = due_tick(job);
+
+    // Beyond the last level: park it in the farthest slot, it is
+    // re-inserted (and checked again) when that slot cascades
+    long long horizon = 1LL << (WHEEL_BITS * WHEEL_LEVELS);
+    if (t - s_now >= horizon)
+        t = s_now + horizon - 1;
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           (t >> (WHEEL_BITS * (level + 1))) != (s_now >> (WHEEL_BITS * (level + 1))))
+        level++;
+
+    int slot = (int)((t >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+    job->next = s_wheel[level][slot];
+    s_wheel[level][slot] = job;
+    s_count++;
+}
+
+// Due (or overdue) job: back to the workers
+static void expire(Job *job)
+{
+    atomic_fetch_sub(&s_suspended, 1);
+    queue_requeue(job);
+}
+
+// Move every job of one slot to where it belongs now
+static void cascade(int level, int slot)
+{
+    Job *list = s_wheel[level][slot];
+    s_wheel[level][slot] = NULL;
+
+    while (list) {
+        Job *next = list->next;
+        s_count--;
+        if (due_tick(list) <= s_now)
+            expire(list);
+        else
+            wheel_insert(list);
+        list = next;
+    }
+}
+
+// Advance the wheel by one tick and fire what is due
+static void wheel_tick(void)
+{
+    s_now++;
+
+    // Entering a new slot of a higher level: cascade, highest level first
+    for (int level = WHEEL_LEVELS - 1; level >= 1; level--) {
+        long long span = 1LL << (WHEEL_BITS * level);
+        if (s_now % span == 0)
+            cascade(level, (int)((s_now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)));
+    }
+
+    cascade(0, (int)(s_now & (WHEEL_SLOTS - 1)));
+}
+
+// Ticks until something can be due: the next non-empty level-0 slot, or
+// the next level-1 boundary (where a cascade may bring new work)
+static long long ticks_to_next_event(void)
+{
+    long long to_boundary = WHEEL_SLOTS - (s_now & (WHEEL_SLOTS - 1));
+    for (long long d = 1; d < to_boundary; d++)
+        if (s_wheel[0][(s_now + d) & (WHEEL_SLOTS - 1)])
+            return d;
+    return to_boundary;
+}
+
+
+// ============================================================================
+// TIMER THREAD
+// ============================================================================
+
+static void *timer_thread_main(void *arg)
+{
+    (void)arg;
+
+    while (!atomic_load(&s_stop)) {
+
+        // 1. Catch up with the clock
+        long long now = since_start_ns() / WHEEL_TICK_NS;
+        if (s_count == 0)
+            s_now = now;            // nothing to fire on the way
+        while (s_now < now)
+            wheel_tick();
+
+        // 2. Take the new timers
+        Job *list = atomic_exchange(&s_incoming, NULL);
+        while (list) {
+            Job *next = list->next;
+            if (due_tick(list) <= s_now)
+                expire(list);
+            else
+                wheel_insert(list);
+            list = next;
+        }
+
+        // 3. Sleep until the next possible expiry, or until timer_add
+        //    wakes us (eventcount, like the queues)
+        unsigned int ev = atomic_load(&s_event);
+        atomic_store(&s_sleeping, 1);
+        if (atomic_load(&s_incoming) == NULL && !atomic_load(&s_stop)) {
+            if (s_count == 0)
+                futex_wait(&s_event, ev);
+            else {
+                // To the start of that tick, not a whole tick from now
+                long long wake = (s_now + ticks_to_next_event()) * WHEEL_TICK_NS;
+                long long left = wake - since_start_ns();
+                if (left > 0)
+                    futex_wait_ns(&s_event, ev, left);
+            }
+        }
+        atomic_store(&s_sleeping, 0);
+    }
+    return NULL;
+}
+
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+int timer_init(void)
+{
+    if (g_msleep_mode != MSLEEP_TIMER)
+        return 0;
+
+    s_now = since_start_ns() / WHEEL_TICK_NS;
+    int rc = pthread_create(&s_thread, NULL, timer_thread_main, NULL);
+    if (rc != 0) {
+        errno = rc;
+        report_syscall_error("pthread_create");
+        return -1;
+    }
+    s_started = 1;
+    return 0;
+}
+
+void timer_add(Job *job, int ms)
+{
+    job->wake_ns = since_start_ns() + (long long)ms * 1000000;
+    atomic_fetch_add(&s_suspended, 1);
+
+    // Push on the incoming stack
+    Job *head = atomic_load_explicit(&s_incoming, memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&s_incoming, &head, job,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+
+    // Wake the timer thread if it sleeps (it may sleep past our deadline)
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&s_sleeping)) {
+        atomic_fetch_add(&s_event, 1);
+        futex_wake(&s_event, 1);
+    }
+}
+
+int timer_suspended(void)
+{
+    return atomic_load(&s_suspended);
+}
+
+void timer_shutdown(void)
+{
+    if (!s_started)
+        return;
+
+    atomic_store(&s_stop, 1);
+    atomic_fetch_add(&s_event, 1);
+    futex_wake(&s_event, 1);
+    pthread_join(s_thread, NULL);
+    s_started = 0;
+}
@@ -0,0 +1,209 @@
+// ============================================================================
+// topo.c  — CPU/NUMA topology, worker pinning, node-local allocation
+// ============================================================================
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "../header/func.h"
+#include "../header/topo.h"
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+int g_affinity_mode = AFFINITY_NONE;
+
+static int s_order[CPU_SETSIZE];   // CPU of worker i is s_order[i % s_num_cpus]
+static int s_node[CPU_SETSIZE];    // node of s_order[k]
+static int s_num_cpus  = 0;
+static int s_num_nodes = 1;
+
+
+// ============================================================================
+// DISCOVERY
+// ============================================================================
+
+// Node of a CPU: libnuma if we have it, else the nodeN entry in sysfs
+static int node_of_cpu(int cpu)
+{
+#ifdef HAVE_LIBNUMA
+    if (numa_available() >= 0) {
+        int node = numa_node_of_cpu(cpu);
+        return (node < 0) ? 0 : node;
+    }
+#endif
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR *d = opendir(path);
+    if (!d)
+        return 0;
+
+    int node = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (strncmp(e->d_name, "node", 4) == 0 && isdigit((unsigned char)e->d_name[4])) {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+int topo_init(void)
+{
+    if (g_affinity_mode == AFFINITY_NONE)
+        return 0;
+
+    // CPUs we may run on (taskset/cgroups may have narrowed them)
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        report_syscall_error("sched_getaffinity");
+        return -1;
+    }
+
+    static int cpu_list[CPU_SETSIZE], cpu_node[CPU_SETSIZE];
+    int n = 0, max_node = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+        cpu_list[n] = cpu;
+        cpu_node[n] = node_of_cpu(cpu);
+        if (cpu_node[n] > max_node)
+            max_node = cpu_node[n];
+        n++;
+    }
+    if (n == 0)
+        return 0;
+
+    // compact: node by node. scatter: take one CPU of each node in turn.
+    int k = 0;
+    if (g_affinity_mode == AFFINITY_COMPACT) {
+        for (int node = 0; node <= max_node; node++)
+            for (int i = 0; i < n; i++)
+                if (cpu_node[i] == node) {
+                    s_order[k] = cpu_list[i];
+                    s_node[k++] = node;
+                }
+    } else {
+        static int next[CPU_SETSIZE];   // per node: next index in cpu_list
+        memset(next, 0, sizeof(int) * (size_t)(max_node + 1));
+        while (k < n) {
+            for (int node = 0; node <= max_node; node++) {
+                int i = next[node];
+                while (i < n && cpu_node[i] != node)
+                    i++;
+                next[node] = i + 1;
+                if (i < n) {
+                    s_order[k] = cpu_list[i];
+                    s_node[k++] = node;
+                }
+            }
+        }
+    }
+    s_num_cpus = n;
+
+    // Nodes that actually have one of our CPUs
+    s_num_nodes = 0;
+    for (int node = 0; node <= max_node; node++) {
+        for (int i = 0; i < n; i++)
+            if (cpu_node[i] == node) {
+                s_num_nodes++;
+                break;
+            }
+    }
+
+    // Tell the user what we chose
+    printf("hw2: topology: %d CPU(s) on %d NUMA node(s) (%s)\n", n, s_num_nodes,
+#ifdef HAVE_LIBNUMA
+           numa_available() >= 0 ? "libnuma" : "sysfs"
+#else
+           "sysfs"
+#endif
+           );
+    for (int node = 0; node <= max_node; node++) {
+        int first = 1;
+        for (int i = 0; i < n; i++) {
+            if (cpu_node[i] != node)
+                continue;
+            if (first)
+                printf("hw2:   node %d: cpus", node);
+            printf(" %d", cpu_list[i]);
+            first = 0;
+        }
+        if (!first)
+            printf("\n");
+    }
+    printf("hw2: affinity=%s: worker i -> cpu order[i %% %d]:",
+           g_affinity_mode == AFFINITY_COMPACT ? "compact" : "scatter", n);
+    for (int i = 0; i < n; i++)
+        printf(" %d", s_order[i]);
+    printf("\n");
+    fflush(stdout);
+    return 0;
+}
+
+
+// ============================================================================
+// PINNING
+// ============================================================================
+
+void topo_pin_worker(int worker_id)
+{
+    if (s_num_cpus == 0)
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(s_order[worker_id % s_num_cpus], &set);
+
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        errno = rc;
+        report_syscall_error("pthread_setaffinity_np");
+    }
+}
+
+int topo_worker_node(int worker_id)
+{
+    if (s_num_cpus == 0)
+        return -1;
+    return s_node[worker_id % s_num_cpus];
+}
+
+
+// ============================================================================
+// MEMORY
+// ============================================================================
+
+void topo_bind(void *p, size_t size, int node)
+{
+#ifdef HAVE_LIBNUMA
+    if (node >= 0 && numa_available() >= 0)
+        numa_tonode_memory(p, size, node);
+#else
+    (void)p;
+    (void)size;
+    (void)node;
+#endif
+}
+
+void *topo_alloc_on_node(size_t size, int node)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        report_syscall_error("mmap");
+        return NULL;
+    }
+    topo_bind(p, size, node);
+    return p;
+}
+
+void topo_free(void *p, size_t size)
+{
+    if (p)
+        munmap(p, size);
+}
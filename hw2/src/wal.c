@@ -0,0 +1,635 @@
+// ============================================================================
+// wal.c  — Write-ahead log: group commit, snapshots, recovery (see wal.h)
+// ============================================================================
+//
+// Workers copy their records into s_buf under s_lock and sleep on
+// s_committed. The committer swaps s_buf with the spare buffer, writes
+// and syncs the records without the lock, then moves s_durable (offset
+// in this run's WAL stream that is on disk) and wakes them all.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../header/func.h"
+#include "../header/futex.h"   // CACHE_LINE
+#include "../header/queue.h"   // g_queue_batch
+#include "../header/pool.h"
+#include "../header/wal.h"
+
+int g_durable     = 0;
+int g_commit_us   = COMMIT_US_DEFAULT;
+int g_commit_jobs = 0;
+int g_snapshot_mb = SNAPSHOT_MB_DEFAULT;
+
+// Deltas of the worker's current batch: open addressing on the counter
+// id, like the delta-mode tables in counters.c. Only its owner uses it.
+#define WAL_BITS      9
+#define WAL_SLOTS     (1 << WAL_BITS)
+#define WAL_FLUSH_AT  (WAL_SLOTS * 3 / 4)   // then a record of its own
+
+typedef struct WalSlot {
+    int       key;           // cid + 1, 0 = empty
+    long long delta;
+} WalSlot;
+
+typedef struct WorkerLog {
+    _Alignas(CACHE_LINE) WalSlot *slot;   // WAL_SLOTS entries
+    int       *dirty;        // slots in use
+    int        num_dirty;
+    WalEntry  *entries;      // the record being built (WAL_FLUSH_AT)
+    long long  end;          // stream offset past our last record
+} WorkerLog;
+
+static WorkerLog *s_logs     = NULL;
+static int        s_num_logs = 0;
+
+// Shared with the committer (s_lock)
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  s_work;           // records came in / stop
+static pthread_cond_t  s_committed;      // s_durable moved
+static char     *s_buf       = NULL;     // records not written yet
+static size_t    s_len       = 0;
+static size_t    s_cap       = 0;
+static char     *s_spare     = NULL;     // the committer writes this one
+static size_t    s_spare_cap = 0;
+static int       s_jobs      = 0;        // jobs behind the records in s_buf
+static int       s_waiters   = 0;        // workers in wal_commit
+static long long s_first_ns  = 0;        // when s_buf got its first record
+static long long s_appended  = 0;        // stream offset past the last record
+static long long s_durable   = 0;        // ... past the last synced one
+static long long s_wal_size  = 0;        // bytes in counters.wal
+static unsigned long long s_seq = 0;     // last sequence number given out
+static int       s_stop      = 0;
+
+static int       s_commit_jobs = 0;      // g_commit_jobs or its default
+static unsigned long long s_snap_seq = 0;   // last record in counters.snap
+static int       s_fd      = -1;
+static pthread_t s_thread;
+static int       s_started = 0;
+
+// stats.txt (s_lock)
+static long long s_commits   = 0;
+static long long s_records   = 0;
+static long long s_commit_ns = 0;        // in write + fdatasync
+static long long s_snapshots = 0;
+
+static unsigned int s_crc_table[256];
+
+
+// ============================================================================
+// HELPERS
+// ============================================================================
+
+static void crc_init(void)
+{
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        s_crc_table[i] = c;
+    }
+}
+
+// CRC-32 of p[0 .. n), going on from crc (0 to start)
+static unsigned int crc32_update(unsigned int crc, const void *p, size_t n)
+{
+    const unsigned char *b = p;
+    crc = ~crc;
+    while (n--)
+        crc = s_crc_table[(crc ^ *b++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// The crc of a record, given the crc of its entries
+static unsigned int record_crc(const WalRecord *rec, unsigned int entries_crc)
+{
+    unsigned int crc = crc32_update(entries_crc, &rec->count, sizeof(rec->count));
+    return crc32_update(crc, &rec->seq, sizeof(rec->seq));
+}
+
+static int write_all(int fd, const void *p, size_t len)
+{
+    const char *b = p;
+    while (len > 0) {
+        ssize_t n = write(fd, b, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            report_syscall_error("write");
+            return -1;
+        }
+        b   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// A record could not be made durable. Its jobs were not reported done
+// and must not be: stop here, as a crash would. Recovery keeps what is
+// on disk and cuts a torn tail.
+static void wal_fail(void)
+{
+    fprintf(stderr, "hw2: %s: cannot log counter updates, stopping\n", WAL_FILE);
+    _exit(EXIT_FAILURE);
+}
+
+static int read_all(int fd, void *p, size_t len)
+{
+    char *b = p;
+    while (len > 0) {
+        ssize_t n = read(fd, b, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        b   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+
+// ============================================================================
+// RECOVERY
+// ============================================================================
+
+// counters.snap into values (missing file: a first run, all zero)
+static int load_snapshot(long long *values, int num_counters, unsigned long long *seq)
+{
+    int fd = open(SNAPSHOT_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            return 0;
+        report_syscall_error("open");
+        return -1;
+    }
+
+    SnapshotHeader h;
+    int rc = -1;
+    if (read_all(fd, &h, sizeof(h)) != 0 ||
+        memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 || h.num_counters < 0)
+        fprintf(stderr, "hw2: %s is not a snapshot\n", SNAPSHOT_FILE);
+    else if (h.num_counters > num_counters)
+        fprintf(stderr, "hw2: %s holds %d counters, more than %d\n",
+                SNAPSHOT_FILE, h.num_counters, num_counters);
+    else if (read_all(fd, values, sizeof(long long) * (size_t)h.num_counters) != 0 ||
+             crc32_update(0, values, sizeof(long long) * (size_t)h.num_counters) != h.crc)
+        fprintf(stderr, "hw2: %s is corrupt\n", SNAPSHOT_FILE);
+    else {
+        *seq = h.seq;
+        rc = 0;
+    }
+    close(fd);
+    return rc;
+}
+
+// Add the records after *seq to values. The WAL is cut after the last
+// intact record (a crash in the middle of a write leaves a torn one).
+static int replay_wal(long long *values, int num_counters, unsigned long long *seq,
+                      long long *replayed)
+{
+    struct stat st;
+    if (fstat(s_fd, &st) != 0) {
+        report_syscall_error("fstat");
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    size_t good = 0;       // end of the last intact record
+    if (size > 0) {
+        const char *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, s_fd, 0);
+        if (p == MAP_FAILED) {
+            report_syscall_error("mmap");
+            return -1;
+        }
+
+        while (size - good >= sizeof(WalRecord)) {
+            WalRecord rec;
+            memcpy(&rec, p + good, sizeof(rec));
+            if (rec.magic != WAL_MAGIC ||
+                rec.count > (size - good - sizeof(rec)) / sizeof(WalEntry))
+                break;
+
+            // Records are multiples of 8 bytes, so the entries are aligned
+            const WalEntry *e = (const WalEntry *)(p + good + sizeof(rec));
+            size_t bytes = sizeof(WalEntry) * rec.count;
+            if (record_crc(&rec, crc32_update(0, e, bytes)) != rec.crc)
+                break;
+
+            // Older ones are in the snapshot already
+            if (rec.seq > *seq) {
+                for (unsigned int i = 0; i < rec.count; i++) {
+                    if (e[i].cid < 0 || e[i].cid >= num_counters) {
+                        fprintf(stderr, "hw2: %s: counter %d out of range\n",
+                                WAL_FILE, e[i].cid);
+                        munmap((void *)p, size);
+                        return -1;
+                    }
+                    values[e[i].cid] += e[i].delta;
+                }
+                *seq = rec.seq;
+                (*replayed)++;
+            }
+            good += sizeof(rec) + bytes;
+        }
+        munmap((void *)p, size);
+    }
+
+    if (good < size) {
+        fprintf(stderr, "hw2: %s: dropped %zu bytes after the last intact record\n",
+                WAL_FILE, size - good);
+        if (ftruncate(s_fd, (off_t)good) != 0 || fdatasync(s_fd) != 0) {
+            report_syscall_error("ftruncate");
+            return -1;
+        }
+    }
+    s_wal_size = (long long)good;
+    return 0;
+}
+
+
+// ============================================================================
+// COMMITTER THREAD
+// ============================================================================
+
+static void *committer_main(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&s_lock);
+    for (;;) {
+        // 1. Wait for the first record
+        while (s_len == 0 && !s_stop)
+            pthread_cond_wait(&s_work, &s_lock);
+        if (s_len == 0)
+            break;              // stopping and nothing left
+
+        // 2. Group commit window: let other workers' records join, unless
+        //    enough jobs wait or nobody else could add one
+        long long deadline = s_first_ns + (long long)g_commit_us * 1000;
+        while (!s_stop && s_jobs < s_commit_jobs && s_waiters < pool_size() &&
+               now_ns() < deadline) {
+            struct timespec ts = { (time_t)(deadline / 1000000000LL),
+                                   (long)(deadline % 1000000000LL) };
+            pthread_cond_timedwait(&s_work, &s_lock, &ts);
+        }
+
+        // 3. Take the buffer; workers fill the spare one meanwhile
+        char  *out     = s_buf;
+        size_t len     = s_len;
+        size_t out_cap = s_cap;
+        long long end  = s_appended;
+        s_buf       = s_spare;
+        s_cap       = s_spare_cap;
+        s_len       = 0;
+        s_jobs      = 0;
+        pthread_mutex_unlock(&s_lock);
+
+        // 4. One write, one fdatasync for all of them
+        long long t0 = now_ns();
+        int rc = write_all(s_fd, out, len);
+        if (rc == 0 && fdatasync(s_fd) != 0) {
+            report_syscall_error("fdatasync");
+            rc = -1;
+        }
+        long long t1 = now_ns();
+
+        // Before anyone is told: the waiting workers never return
+        if (rc != 0)
+            wal_fail();
+
+        pthread_mutex_lock(&s_lock);
+        s_spare     = out;
+        s_spare_cap = out_cap;
+        s_wal_size  += (long long)len;
+        s_durable    = end;
+        s_commits++;
+        s_commit_ns += t1 - t0;
+        pthread_cond_broadcast(&s_committed);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return NULL;
+}
+
+
+// ============================================================================
+// WORKER SIDE
+// ============================================================================
+
+// The worker's table becomes one record in s_buf
+static void append_record(WorkerLog *wl, int jobs)
+{
+    unsigned int count = 0;
+    for (int i = 0; i < wl->num_dirty; i++) {
+        WalSlot *s = &wl->slot[wl->dirty[i]];
+        if (s->delta != 0) {
+            wl->entries[count].cid    = s->key - 1;
+            wl->entries[count].unused = 0;
+            wl->entries[count].delta  = s->delta;
+            count++;
+        }
+        s->key   = 0;
+        s->delta = 0;
+    }
+    wl->num_dirty = 0;
+    if (count == 0)
+        return;
+
+    size_t bytes = sizeof(WalEntry) * count;
+    size_t size  = sizeof(WalRecord) + bytes;
+    unsigned int entries_crc = crc32_update(0, wl->entries, bytes);
+
+    pthread_mutex_lock(&s_lock);
+
+    if (s_len + size > s_cap) {
+        size_t cap = s_cap ? s_cap * 2 : 64 * 1024;
+        while (cap < s_len + size)
+            cap *= 2;
+        char *p = realloc(s_buf, cap);
+        if (!p) {
+            report_syscall_error("realloc");
+            wal_fail();
+        }
+        s_buf = p;
+        s_cap = cap;
+    }
+
+    WalRecord rec;
+    rec.magic  = WAL_MAGIC;
+    rec.count  = count;
+    rec.seq    = ++s_seq;
+    rec.crc    = record_crc(&rec, entries_crc);
+    rec.unused = 0;
+    memcpy(s_buf + s_len, &rec, sizeof(rec));
+    memcpy(s_buf + s_len + sizeof(rec), wl->entries, bytes);
+
+    if (s_len == 0)
+        s_first_ns = now_ns();
+    s_len      += size;
+    s_jobs     += jobs;
+    s_appended += (long long)size;
+    s_records++;
+    wl->end = s_appended;
+
+    // The committer waits for a first record, or for the window to end
+    if (s_len == size || s_jobs >= s_commit_jobs)
+        pthread_cond_signal(&s_work);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void wal_add(int worker_id, int cid, long long delta)
+{
+    WorkerLog *wl = &s_logs[worker_id];
+    if (wl->num_dirty >= WAL_FLUSH_AT)
+        append_record(wl, 0);
+
+    unsigned int h = ((unsigned int)cid * 2654435761u) >> (32 - WAL_BITS);
+    for (;;) {
+        WalSlot *s = &wl->slot[h];
+        if (s->key == cid + 1) {
+            s->delta += delta;
+            return;
+        }
+        if (s->key == 0) {
+            s->key   = cid + 1;
+            s->delta = delta;
+            wl->dirty[wl->num_dirty++] = (int)h;
+            return;
+        }
+        h = (h + 1) & (WAL_SLOTS - 1);
+    }
+}
+
+void wal_commit(int worker_id, int jobs)
+{
+    WorkerLog *wl = &s_logs[worker_id];
+    append_record(wl, jobs);
+
+    pthread_mutex_lock(&s_lock);
+    if (s_durable < wl->end) {
+        // The last worker to wait ends the window
+        if (++s_waiters >= pool_size())
+            pthread_cond_signal(&s_work);
+        while (s_durable < wl->end)
+            pthread_cond_wait(&s_committed, &s_lock);
+        s_waiters--;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+
+// ============================================================================
+// SNAPSHOTS
+// ============================================================================
+
+// Make a rename in the current directory durable
+static int sync_dir(void)
+{
+    int fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        report_syscall_error("open");
+        return -1;
+    }
+    int rc = fsync(fd);
+    if (rc != 0)
+        report_syscall_error("fsync");
+    close(fd);
+    return rc;
+}
+
+int wal_checkpoint(const long long *values, int num_counters, int force)
+{
+    if (!s_started)
+        return 0;
+
+    // No job in flight: every record is on disk
+    pthread_mutex_lock(&s_lock);
+    long long wal_size = s_wal_size;
+    unsigned long long seq = s_seq;
+    int pending = (s_durable < s_appended);
+    pthread_mutex_unlock(&s_lock);
+
+    if (pending || seq == s_snap_seq)
+        return 0;
+    if (!force && wal_size < (long long)g_snapshot_mb * 1024 * 1024)
+        return 0;
+
+    // 1. The new snapshot next to the old one
+    size_t bytes = sizeof(long long) * (size_t)num_counters;
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.seq          = seq;
+    h.num_counters = num_counters;
+    h.crc          = crc32_update(0, values, bytes);
+
+    int fd = open(SNAPSHOT_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        report_syscall_error("open");
+        return -1;
+    }
+    int rc = write_all(fd, &h, sizeof(h));
+    if (rc == 0)
+        rc = write_all(fd, values, bytes);
+    if (rc == 0 && fdatasync(fd) != 0) {
+        report_syscall_error("fdatasync");
+        rc = -1;
+    }
+    close(fd);
+    if (rc != 0)
+        return -1;
+
+    // 2. Switch over in one step, and make the switch durable
+    if (rename(SNAPSHOT_FILE ".tmp", SNAPSHOT_FILE) != 0) {
+        report_syscall_error("rename");
+        return -1;
+    }
+    if (sync_dir() != 0)
+        return -1;
+    s_snap_seq = seq;
+
+    // 3. Every record is in the snapshot now (a crash before this point
+    //    replays none of them: their seq is not above the snapshot's)
+    if (ftruncate(s_fd, 0) != 0 || fdatasync(s_fd) != 0) {
+        report_syscall_error("ftruncate");
+        return -1;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    s_wal_size = 0;
+    s_snapshots++;
+    pthread_mutex_unlock(&s_lock);
+    return 0;
+}
+
+
+// ============================================================================
+// INIT / CLOSE
+// ============================================================================
+
+int wal_init(long long *values, int num_counters, int num_workers)
+{
+    if (!g_durable)
+        return 0;
+
+    crc_init();
+
+    // 1. Recover: the snapshot, then the records after it
+    unsigned long long seq = 0;
+    long long replayed = 0;
+    if (load_snapshot(values, num_counters, &seq) != 0)
+        return -1;
+    s_snap_seq = seq;
+
+    s_fd = open(WAL_FILE, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (s_fd < 0) {
+        report_syscall_error("open");
+        return -1;
+    }
+    if (replay_wal(values, num_counters, &seq, &replayed) != 0)
+        return -1;
+    s_seq = seq;
+
+    if (s_snap_seq > 0)
+        printf("hw2: recovered counters from %s (up to record %llu) and %lld records of %s\n",
+               SNAPSHOT_FILE, s_snap_seq, replayed, WAL_FILE);
+    else if (replayed > 0)
+        printf("hw2: recovered counters from %lld records of %s\n", replayed, WAL_FILE);
+
+    // 2. The workers' tables
+    s_logs = aligned_alloc(CACHE_LINE, sizeof(WorkerLog) * (size_t)num_workers);
+    if (!s_logs) {
+        report_syscall_error("aligned_alloc");
+        return -1;
+    }
+    memset(s_logs, 0, sizeof(WorkerLog) * (size_t)num_workers);
+    s_num_logs = num_workers;
+    for (int w = 0; w < num_workers; w++) {
+        WorkerLog *wl = &s_logs[w];
+        wl->slot    = calloc(WAL_SLOTS, sizeof(WalSlot));
+        wl->dirty   = malloc(sizeof(int) * WAL_SLOTS);
+        wl->entries = malloc(sizeof(WalEntry) * WAL_FLUSH_AT);
+        if (!wl->slot || !wl->dirty || !wl->entries) {
+            report_syscall_error("malloc");
+            return -1;
+        }
+    }
+
+    // 3. The committer (its window is timed on the monotonic clock)
+    s_commit_jobs = (g_commit_jobs > 0) ? g_commit_jobs : num_workers * g_queue_batch;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_work, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&s_committed, NULL);
+
+    int rc = pthread_create(&s_thread, NULL, committer_main, NULL);
+    if (rc != 0) {
+        errno = rc;
+        report_syscall_error("pthread_create");
+        return -1;
+    }
+    s_started = 1;
+    return 0;
+}
+
+void wal_close(const long long *values, int num_counters)
+{
+    if (!s_started)
+        return;
+
+    pthread_mutex_lock(&s_lock);
+    s_stop = 1;
+    pthread_cond_signal(&s_work);
+    pthread_mutex_unlock(&s_lock);
+    pthread_join(s_thread, NULL);
+
+    // Restart from the snapshot alone
+    if (wal_checkpoint(values, num_counters, 1) != 0)
+        fprintf(stderr, "hw2: could not write %s\n", SNAPSHOT_FILE);
+
+    s_started = 0;
+    close(s_fd);
+    s_fd = -1;
+    pthread_cond_destroy(&s_work);
+    pthread_cond_destroy(&s_committed);
+
+    for (int w = 0; w < s_num_logs; w++) {
+        free(s_logs[w].slot);
+        free(s_logs[w].dirty);
+        free(s_logs[w].entries);
+    }
+    free(s_logs);
+    s_logs     = NULL;
+    s_num_logs = 0;
+    free(s_buf);
+    free(s_spare);
+    s_buf   = NULL;
+    s_spare = NULL;
+    s_cap   = 0;
+    s_spare_cap = 0;
+}
+
+
+// ============================================================================
+// STATS
+// ============================================================================
+
+void wal_write_stats(FILE *f)
+{
+    if (!s_started)
+        return;
+
+    pthread_mutex_lock(&s_lock);
+    long long commits = s_commits, records = s_records;
+    long long commit_ns = s_commit_ns, snapshots = s_snapshots;
+    pthread_mutex_unlock(&s_lock);
+
+    fprintf(f, "wal group commits: %lld, records per commit: %.2f, "
+               "average commit time: %.3f milliseconds\n",
+            commits, commits ? (double)records / (double)commits : 0.0,
+            commits ? (double)commit_ns / (double)commits / 1e6 : 0.0);
+    fprintf(f, "wal snapshots: %lld\n", snapshots);
+}
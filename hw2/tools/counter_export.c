@@ -0,0 +1,99 @@
+// ============================================================================
+// counter_export.c  — Write the legacy countNN.txt files from counters.bin
+// ============================================================================
+//
+// Usage:
+//   counter_export counters.bin                 every counter
+//   counter_export counters.bin <first> <n>     counters first .. first+n-1
+//   counter_export counters.bin list            "id value" lines on stdout,
+//                                               non-zero counters only
+//
+// counters.bin holds one native long long per counter (counter cid at
+// offset cid * 8), as hw2 leaves it at exit (see header/counters.h).
+// The files are written to the current directory, one "value\n" each,
+// exactly like hw2 ... export=text.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int write_counter_file(long cid, long long val)
+{
+    char fname[32];
+    snprintf(fname, sizeof(fname), "count%02ld.txt", cid);
+
+    FILE *f = fopen(fname, "w");
+    if (!f) {
+        perror(fname);
+        return -1;
+    }
+    fprintf(f, "%lld\n", val);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: counter_export <counters.bin> [<first> <n> | list]\n");
+        return 1;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        close(fd);
+        return 1;
+    }
+
+    long num = (long)(st.st_size / (off_t)sizeof(long long));
+    if (num == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const long long *values = mmap(NULL, (size_t)num * sizeof(long long),
+                                   PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (values == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    int rc = 0;
+    if (argc == 3) {
+        if (strcmp(argv[2], "list") != 0) {
+            fprintf(stderr, "counter_export: unknown mode %s\n", argv[2]);
+            rc = 1;
+        } else {
+            for (long i = 0; i < num; i++)
+                if (values[i] != 0)
+                    printf("%ld %lld\n", i, values[i]);
+        }
+    } else {
+        long first = 0, n = num;
+        if (argc == 4) {
+            first = atol(argv[2]);
+            n     = atol(argv[3]);
+        }
+        if (first < 0 || n < 0 || first > num || n > num - first) {
+            fprintf(stderr, "counter_export: range outside 0..%ld\n", num - 1);
+            rc = 1;
+        } else {
+            for (long i = first; i < first + n && rc == 0; i++)
+                if (write_counter_file(i, values[i]) != 0)
+                    rc = 1;
+        }
+    }
+
+    munmap((void *)values, (size_t)num * sizeof(long long));
+    return rc;
+}
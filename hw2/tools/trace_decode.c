@@ -0,0 +1,330 @@
+// ============================================================================
+// trace_decode.c  — Turn a trace.bin (hw2 ... log=binary) back into text
+// ============================================================================
+//
+// Usage:
+//   trace_decode trace.bin text            write dispatcher.txt and
+//                                          threadNN.txt (same as log=async)
+//   trace_decode trace.bin chrome out.json Chrome-trace JSON (open it in
+//                                          chrome://tracing or Perfetto)
+//
+// The whole file is read into memory, the frames are put back together
+// into one stream per sink, and the dispatcher stream is read first to
+// learn the text of every job.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../header/trace.h"
+
+typedef struct Stream {
+    char  *data;
+    size_t len;
+    size_t cap;
+} Stream;
+
+typedef struct Str {
+    const char  *text;
+    unsigned int len;
+} Str;
+
+static Stream       *s_streams   = NULL;   // num_workers + 1
+static unsigned int  s_num_sinks = 0;
+
+static Str          *s_strings   = NULL;   // by string id
+static size_t        s_num_str   = 0;
+static unsigned int *s_job_str   = NULL;   // job id -> string id
+static size_t        s_num_jobs  = 0;
+
+
+static void *grow(void *p, size_t *cap, size_t need, size_t elem)
+{
+    if (need <= *cap)
+        return p;
+    size_t c = *cap ? *cap : 1024;
+    while (c < need)
+        c *= 2;
+    void *q = realloc(p, c * elem);
+    if (!q) {
+        fprintf(stderr, "trace_decode: out of memory\n");
+        exit(1);
+    }
+    memset((char *)q + *cap * elem, 0, (c - *cap) * elem);
+    *cap = c;
+    return q;
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    char  *buf = NULL;
+    size_t cap = 0;
+    *len = 0;
+    while (1) {
+        buf = grow(buf, &cap, *len + 65536, 1);
+        size_t n = fread(buf + *len, 1, cap - *len, f);
+        if (n == 0)
+            break;
+        *len += n;
+    }
+    fclose(f);
+    return buf;
+}
+
+// Split the frames into per-sink streams
+static int load_streams(const char *buf, size_t len)
+{
+    TraceFileHeader h;
+    if (len < sizeof(h)) {
+        fprintf(stderr, "trace_decode: file too short\n");
+        return -1;
+    }
+    memcpy(&h, buf, sizeof(h));
+    if (memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != TRACE_VERSION) {
+        fprintf(stderr, "trace_decode: not a version %d trace file\n", TRACE_VERSION);
+        return -1;
+    }
+
+    s_num_sinks = h.num_workers + 1;
+    s_streams = calloc(s_num_sinks, sizeof(Stream));
+    if (!s_streams)
+        return -1;
+
+    size_t pos = sizeof(h);
+    while (pos + sizeof(TraceFrame) <= len) {
+        TraceFrame f;
+        memcpy(&f, buf + pos, sizeof(f));
+        pos += sizeof(f);
+
+        if (f.sink >= s_num_sinks || f.len > len - pos) {
+            fprintf(stderr, "trace_decode: bad frame at offset %zu\n", pos);
+            return -1;
+        }
+        Stream *st = &s_streams[f.sink];
+        st->data = grow(st->data, &st->cap, st->len + f.len, 1);
+        memcpy(st->data + st->len, buf + pos, f.len);
+        st->len += f.len;
+        pos += f.len;
+    }
+    return 0;
+}
+
+// Read one record (and its payload) from a stream. Returns 0 at the end.
+static int next_record(const Stream *st, size_t *pos, TraceRecord *rec,
+                       unsigned int *arg, const char **text)
+{
+    if (*pos + sizeof(*rec) > st->len)
+        return 0;
+    memcpy(rec, st->data + *pos, sizeof(*rec));
+    *pos += sizeof(*rec);
+
+    if (rec->event == TRACE_STRING || rec->event == TRACE_READ) {
+        if (*pos + sizeof(*arg) > st->len)
+            return 0;
+        memcpy(arg, st->data + *pos, sizeof(*arg));
+        *pos += sizeof(*arg);
+    }
+    if (rec->event == TRACE_STRING) {
+        if (*pos + *arg > st->len)
+            return 0;
+        *text = st->data + *pos;
+        *pos += *arg;
+    }
+    return 1;
+}
+
+// Dispatcher stream: string table and job id -> string id
+static void load_strings(void)
+{
+    const Stream *st = &s_streams[s_num_sinks - 1];
+    size_t str_cap = 0, job_cap = 0;
+    size_t pos = 0;
+    TraceRecord rec;
+    unsigned int arg = 0;
+    const char *text = NULL;
+
+    while (next_record(st, &pos, &rec, &arg, &text)) {
+        if (rec.event == TRACE_STRING) {
+            s_strings = grow(s_strings, &str_cap, (size_t)rec.job_id + 1, sizeof(Str));
+            s_strings[rec.job_id].text = text;
+            s_strings[rec.job_id].len  = arg;
+            if (rec.job_id >= s_num_str)
+                s_num_str = (size_t)rec.job_id + 1;
+        } else if (rec.event == TRACE_READ) {
+            s_job_str = grow(s_job_str, &job_cap, (size_t)rec.job_id + 1, sizeof(unsigned int));
+            s_job_str[rec.job_id] = arg;
+            if (rec.job_id >= s_num_jobs)
+                s_num_jobs = (size_t)rec.job_id + 1;
+        }
+    }
+}
+
+static Str job_text(unsigned int job_id)
+{
+    Str none = { "?", 1 };
+    if (job_id >= s_num_jobs)
+        return none;
+    unsigned int sid = s_job_str[job_id];
+    if (sid >= s_num_str || !s_strings[sid].text)
+        return none;
+    return s_strings[sid];
+}
+
+
+// ============================================================================
+// TEXT OUTPUT
+// ============================================================================
+
+static int write_text_file(unsigned int sink, const char *fname)
+{
+    FILE *f = fopen(fname, "w");
+    if (!f) {
+        perror(fname);
+        return -1;
+    }
+
+    const Stream *st = &s_streams[sink];
+    size_t pos = 0;
+    TraceRecord rec;
+    unsigned int arg = 0;
+    const char *text = NULL;
+
+    while (next_record(st, &pos, &rec, &arg, &text)) {
+        long long ms = rec.time_ns / 1000000;
+        Str s = job_text(rec.job_id);
+
+        if (rec.event == TRACE_READ)
+            fprintf(f, "TIME %lld: read cmd line: %.*s\n", ms, (int)s.len, s.text);
+        else if (rec.event == TRACE_START)
+            fprintf(f, "TIME %lld: START job %.*s\n", ms, (int)s.len, s.text);
+        else if (rec.event == TRACE_END)
+            fprintf(f, "TIME %lld: END job %.*s\n", ms, (int)s.len, s.text);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int write_text(void)
+{
+    if (write_text_file(s_num_sinks - 1, "dispatcher.txt") != 0)
+        return -1;
+
+    for (unsigned int w = 0; w + 1 < s_num_sinks; w++) {
+        char fname[32];
+        sprintf(fname, "thread%02u.txt", w);
+        if (write_text_file(w, fname) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+
+// ============================================================================
+// CHROME TRACE OUTPUT
+// ============================================================================
+
+static void json_string(FILE *f, Str s)
+{
+    fputc('"', f);
+    for (unsigned int i = 0; i < s.len; i++) {
+        unsigned char c = (unsigned char)s.text[i];
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static int write_chrome(const char *fname)
+{
+    FILE *f = fopen(fname, "w");
+    if (!f) {
+        perror(fname);
+        return -1;
+    }
+
+    // Dispatcher is shown as the last "thread"
+    unsigned int disp_tid = s_num_sinks - 1;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+               "\"args\":{\"name\":\"dispatcher\"}}", disp_tid);
+    for (unsigned int w = 0; w < disp_tid; w++)
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                   "\"args\":{\"name\":\"worker %02u\"}}", w, w);
+
+    for (unsigned int sink = 0; sink < s_num_sinks; sink++) {
+        const Stream *st = &s_streams[sink];
+        size_t pos = 0;
+        TraceRecord rec;
+        unsigned int arg = 0;
+        const char *text = NULL;
+
+        while (next_record(st, &pos, &rec, &arg, &text)) {
+            const char *ph;
+            if (rec.event == TRACE_READ)
+                ph = "i";
+            else if (rec.event == TRACE_START)
+                ph = "B";
+            else if (rec.event == TRACE_END)
+                ph = "E";
+            else
+                continue;
+
+            fprintf(f, ",\n{\"name\":");
+            json_string(f, job_text(rec.job_id));
+            fprintf(f, ",\"ph\":\"%s\",\"ts\":%lld.%03lld,\"pid\":1,\"tid\":%u,"
+                       "\"args\":{\"job\":%u}%s}",
+                    ph, rec.time_ns / 1000, rec.time_ns % 1000, sink,
+                    rec.job_id, (rec.event == TRACE_READ) ? ",\"s\":\"t\"" : "");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 ||
+        (strcmp(argv[2], "text") != 0 && strcmp(argv[2], "chrome") != 0) ||
+        (strcmp(argv[2], "chrome") == 0 && argc < 4)) {
+        fprintf(stderr, "Usage: trace_decode <trace.bin> text\n"
+                        "       trace_decode <trace.bin> chrome <out.json>\n");
+        return 1;
+    }
+
+    size_t len;
+    char *buf = read_file(argv[1], &len);
+    if (!buf)
+        return 1;
+
+    if (load_streams(buf, len) != 0)
+        return 1;
+    load_strings();
+
+    int rc;
+    if (strcmp(argv[2], "text") == 0)
+        rc = write_text();
+    else
+        rc = write_chrome(argv[3]);
+
+    // Everything below points into the streams; free in one go
+    for (unsigned int i = 0; i < s_num_sinks; i++)
+        free(s_streams[i].data);
+    free(s_streams);
+    free(s_strings);
+    free(s_job_str);
+    free(buf);
+    return rc == 0 ? 0 : 1;
+}